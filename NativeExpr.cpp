@@ -0,0 +1,936 @@
+//===-------------------------- NativeExpr.cpp ----------------------------===//
+//===----------------------------------------------------------------------===//
+
+#include "NativeExpr.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+using namespace llvm;
+
+static bool AddOverflows(int64_t LHS, int64_t RHS, int64_t &Res) {
+  if ((RHS > 0 && LHS > std::numeric_limits<int64_t>::max() - RHS) ||
+      (RHS < 0 && LHS < std::numeric_limits<int64_t>::min() - RHS))
+    return true;
+  Res = LHS + RHS;
+  return false;
+}
+
+static bool MulOverflows(int64_t LHS, int64_t RHS, int64_t &Res) {
+  bool Overflow;
+  APInt Prod = APInt(64, LHS, true).smul_ov(APInt(64, RHS, true), Overflow);
+  Res = Prod.getSExtValue();
+  return Overflow;
+}
+
+static bool CompareIDs(const NativeNode *LHS, const NativeNode *RHS) {
+  return LHS->getID() < RHS->getID();
+}
+
+//===----------------------------------------------------------------------===//
+// NativeNode
+//===----------------------------------------------------------------------===//
+
+NativeNode::NativeNode(NodeKind Kind, unsigned ID, int64_t Int, StringRef Name,
+                       const NativeNode **Ops, const int64_t *Coeffs,
+                       unsigned NumOps)
+    : Kind_(Kind), ID_(ID), Size_(0), Int_(Int), Name_(Name), Ops_(Ops),
+      Coeffs_(Coeffs), NumOps_(NumOps) {
+  for (unsigned Idx = 0; Idx < NumOps_; ++Idx)
+    Size_ += Ops_[Idx]->getSize();
+  if (NumOps_ == 0 || (Kind_ == NK_Add && Int_ != 0))
+    Size_ += 1;
+}
+
+void NativeNode::Profile(FoldingSetNodeID &ID, NodeKind Kind, int64_t Int,
+                         StringRef Name, ArrayRef<const NativeNode*> Ops,
+                         ArrayRef<int64_t> Coeffs) {
+  ID.AddInteger((unsigned) Kind);
+  ID.AddInteger(Int);
+  ID.AddString(Name);
+  for (auto Op : Ops)
+    ID.AddPointer(Op);
+  for (auto Coeff : Coeffs)
+    ID.AddInteger(Coeff);
+}
+
+void NativeNode::Profile(FoldingSetNodeID &ID) const {
+  Profile(ID, Kind_, Int_, Name_, getOps(), getCoeffs());
+}
+
+static void PrintOperand(raw_ostream &OS, const NativeNode *N) {
+  bool Paren = N->getKind() == NativeNode::NK_Add
+      || N->getKind() == NativeNode::NK_Div;
+  if (Paren)
+    OS << "(";
+  N->print(OS);
+  if (Paren)
+    OS << ")";
+}
+
+static void PrintMagnitude(raw_ostream &OS, int64_t Int) {
+  OS << (Int < 0 ? 0 - (uint64_t) Int : (uint64_t) Int);
+}
+
+void NativeNode::print(raw_ostream &OS) const {
+  switch (Kind_) {
+    case NK_Int:
+      OS << Int_;
+      return;
+    case NK_Sym:
+      OS << Name_;
+      return;
+    case NK_MinusInf:
+      OS << "-Infinity";
+      return;
+    case NK_PlusInf:
+      OS << "+Infinity";
+      return;
+    case NK_Undef:
+      OS << "NaN";
+      return;
+    case NK_Add:
+      for (unsigned Idx = 0; Idx < NumOps_; ++Idx) {
+        int64_t Coeff = Coeffs_[Idx];
+        if (Idx == 0)
+          OS << (Coeff < 0 ? "-" : "");
+        else
+          OS << (Coeff < 0 ? " - " : " + ");
+        if (Coeff != 1 && Coeff != -1) {
+          PrintMagnitude(OS, Coeff);
+          OS << "*";
+        }
+        PrintOperand(OS, Ops_[Idx]);
+      }
+      if (Int_ != 0) {
+        OS << (Int_ < 0 ? " - " : " + ");
+        PrintMagnitude(OS, Int_);
+      }
+      return;
+    case NK_Mul:
+      for (unsigned Idx = 0; Idx < NumOps_; ++Idx) {
+        if (Idx != 0)
+          OS << "*";
+        PrintOperand(OS, Ops_[Idx]);
+      }
+      return;
+    case NK_Div:
+      PrintOperand(OS, Ops_[0]);
+      OS << "/";
+      PrintOperand(OS, Ops_[1]);
+      return;
+    case NK_Min:
+    case NK_Max:
+      OS << (Kind_ == NK_Min ? "min(" : "max(");
+      for (unsigned Idx = 0; Idx < NumOps_; ++Idx) {
+        if (Idx != 0)
+          OS << ", ";
+        Ops_[Idx]->print(OS);
+      }
+      OS << ")";
+      return;
+  }
+}
+
+//===----------------------------------------------------------------------===//
+// NativeContext
+//===----------------------------------------------------------------------===//
+
+const NativeNode *NativeContext::getNode(NativeNode::NodeKind Kind,
+                                         int64_t Int, StringRef Name,
+                                         ArrayRef<const NativeNode*> Ops,
+                                         ArrayRef<int64_t> Coeffs) {
+  FoldingSetNodeID ID;
+  NativeNode::Profile(ID, Kind, Int, Name, Ops, Coeffs);
+
+  void *InsertPos;
+  if (NativeNode *N = Nodes_.FindNodeOrInsertPos(ID, InsertPos))
+    return N;
+
+  char *NameMem = nullptr;
+  if (!Name.empty()) {
+    NameMem = Alloc_.Allocate<char>(Name.size());
+    std::memcpy(NameMem, Name.data(), Name.size());
+  }
+
+  const NativeNode **OpsMem = nullptr;
+  if (!Ops.empty()) {
+    OpsMem = Alloc_.Allocate<const NativeNode*>(Ops.size());
+    std::copy(Ops.begin(), Ops.end(), OpsMem);
+  }
+
+  int64_t *CoeffsMem = nullptr;
+  if (!Coeffs.empty()) {
+    assert(Coeffs.size() == Ops.size() && "Expected a coefficient per operand");
+    CoeffsMem = Alloc_.Allocate<int64_t>(Coeffs.size());
+    std::copy(Coeffs.begin(), Coeffs.end(), CoeffsMem);
+  }
+
+  NativeNode *N = new (Alloc_.Allocate<NativeNode>())
+      NativeNode(Kind, NextID_++, Int, StringRef(NameMem, Name.size()),
+                 OpsMem, CoeffsMem, Ops.size());
+  Nodes_.InsertNode(N, InsertPos);
+  return N;
+}
+
+const NativeNode *NativeContext::getInt(int64_t Int) {
+  return getNode(NativeNode::NK_Int, Int, StringRef(),
+                 ArrayRef<const NativeNode*>(), ArrayRef<int64_t>());
+}
+
+const NativeNode *NativeContext::getSym(StringRef Name) {
+  assert(!Name.empty() && "Symbols must be named");
+  return getNode(NativeNode::NK_Sym, 0, Name,
+                 ArrayRef<const NativeNode*>(), ArrayRef<int64_t>());
+}
+
+const NativeNode *NativeContext::getMinusInf() {
+  return getNode(NativeNode::NK_MinusInf, 0, StringRef(),
+                 ArrayRef<const NativeNode*>(), ArrayRef<int64_t>());
+}
+
+const NativeNode *NativeContext::getPlusInf() {
+  return getNode(NativeNode::NK_PlusInf, 0, StringRef(),
+                 ArrayRef<const NativeNode*>(), ArrayRef<int64_t>());
+}
+
+const NativeNode *NativeContext::getUndef() {
+  return getNode(NativeNode::NK_Undef, 0, StringRef(),
+                 ArrayRef<const NativeNode*>(), ArrayRef<int64_t>());
+}
+
+// Splits a finite node into its constant term and its linear terms.
+static void Decompose(const NativeNode *N, int64_t &Int,
+                      SmallVectorImpl<std::pair<const NativeNode*, int64_t>>
+                          &Terms) {
+  if (N->isInt()) {
+    Int = N->getInt();
+  } else if (N->getKind() == NativeNode::NK_Add) {
+    Int = N->getInt();
+    auto Ops = N->getOps();
+    auto Coeffs = N->getCoeffs();
+    for (unsigned Idx = 0; Idx < Ops.size(); ++Idx)
+      Terms.push_back(std::make_pair(Ops[Idx], Coeffs[Idx]));
+  } else {
+    Int = 0;
+    Terms.push_back(std::make_pair(N, 1));
+  }
+}
+
+// Terms must be sorted by operand ID and have non-zero coefficients.
+const NativeNode *NativeContext::getLinear(int64_t Int,
+                                           SmallVectorImpl<Term> &Terms) {
+  if (Terms.empty())
+    return getInt(Int);
+  if (Terms.size() == 1 && Int == 0 && Terms[0].second == 1)
+    return Terms[0].first;
+
+  SmallVector<const NativeNode*, 4> Ops;
+  SmallVector<int64_t, 4> Coeffs;
+  for (auto &T : Terms) {
+    Ops.push_back(T.first);
+    Coeffs.push_back(T.second);
+  }
+  return getNode(NativeNode::NK_Add, Int, StringRef(), Ops, Coeffs);
+}
+
+const NativeNode *NativeContext::getScaled(const NativeNode *N,
+                                           int64_t Factor) {
+  if (N->isUndef())
+    return N;
+  if (N->isMinusInf() || N->isPlusInf()) {
+    if (Factor == 0)
+      return getInt(0);
+    if (Factor > 0)
+      return N;
+    return N->isMinusInf() ? getPlusInf() : getMinusInf();
+  }
+  if (Factor == 0)
+    return getInt(0);
+  if (Factor == 1)
+    return N;
+
+  int64_t Int;
+  SmallVector<Term, 4> Terms;
+  Decompose(N, Int, Terms);
+
+  if (MulOverflows(Int, Factor, Int))
+    return getUndef();
+  for (auto &T : Terms)
+    if (MulOverflows(T.second, Factor, T.second))
+      return getUndef();
+
+  return getLinear(Int, Terms);
+}
+
+const NativeNode *NativeContext::computeAdd(const NativeNode *LHS,
+                                            const NativeNode *RHS) {
+  if (LHS->isUndef() || RHS->isUndef())
+    return getUndef();
+  if (LHS->isMinusInf() || LHS->isPlusInf()) {
+    bool Opposite = (LHS->isMinusInf() && RHS->isPlusInf())
+        || (LHS->isPlusInf() && RHS->isMinusInf());
+    return Opposite ? getUndef() : LHS;
+  }
+  if (RHS->isMinusInf() || RHS->isPlusInf())
+    return RHS;
+
+  int64_t LInt, RInt, Int;
+  SmallVector<Term, 4> LTerms, RTerms, Terms;
+  Decompose(LHS, LInt, LTerms);
+  Decompose(RHS, RInt, RTerms);
+  if (AddOverflows(LInt, RInt, Int))
+    return getUndef();
+
+  // Merge both term lists, which are sorted by operand ID.
+  auto LI = LTerms.begin(), LE = LTerms.end();
+  auto RI = RTerms.begin(), RE = RTerms.end();
+  while (LI != LE || RI != RE) {
+    if (RI == RE || (LI != LE && CompareIDs(LI->first, RI->first))) {
+      Terms.push_back(*LI++);
+    } else if (LI == LE || CompareIDs(RI->first, LI->first)) {
+      Terms.push_back(*RI++);
+    } else {
+      int64_t Coeff;
+      if (AddOverflows(LI->second, RI->second, Coeff))
+        return getUndef();
+      if (Coeff != 0)
+        Terms.push_back(std::make_pair(LI->first, Coeff));
+      ++LI, ++RI;
+    }
+  }
+
+  return getLinear(Int, Terms);
+}
+
+const NativeNode *NativeContext::getSub(const NativeNode *LHS,
+                                        const NativeNode *RHS) {
+  return getAdd(LHS, getNeg(RHS));
+}
+
+// Splits a node of the form c*N into c and N.
+static int64_t SplitCoeff(const NativeNode *&N) {
+  if (N->getKind() == NativeNode::NK_Add && N->getInt() == 0
+      && N->getOps().size() == 1) {
+    int64_t Coeff = N->getCoeffs()[0];
+    N = N->getOps()[0];
+    return Coeff;
+  }
+  return 1;
+}
+
+const NativeNode *NativeContext::computeMul(const NativeNode *LHS,
+                                            const NativeNode *RHS) {
+  if (LHS->isUndef() || RHS->isUndef())
+    return getUndef();
+  if (LHS->isInt())
+    return getScaled(RHS, LHS->getInt());
+  if (RHS->isInt())
+    return getScaled(LHS, RHS->getInt());
+
+  bool LInf = LHS->isMinusInf() || LHS->isPlusInf(),
+       RInf = RHS->isMinusInf() || RHS->isPlusInf();
+  if (LInf && RInf)
+    return LHS == RHS ? getPlusInf() : getMinusInf();
+  // The sign of a symbolic factor is unknown.
+  if (LInf || RInf)
+    return getUndef();
+
+  int64_t Coeff;
+  if (MulOverflows(SplitCoeff(LHS), SplitCoeff(RHS), Coeff))
+    return getUndef();
+
+  SmallVector<const NativeNode*, 4> Factors;
+  for (auto N : { LHS, RHS })
+    if (N->getKind() == NativeNode::NK_Mul)
+      Factors.append(N->getOps().begin(), N->getOps().end());
+    else
+      Factors.push_back(N);
+  std::sort(Factors.begin(), Factors.end(), CompareIDs);
+
+  const NativeNode *Prod = getNode(NativeNode::NK_Mul, 0, StringRef(), Factors,
+                                   ArrayRef<int64_t>());
+  return getScaled(Prod, Coeff);
+}
+
+const NativeNode *NativeContext::computeDiv(const NativeNode *LHS,
+                                            const NativeNode *RHS) {
+  if (LHS->isUndef() || RHS->isUndef())
+    return getUndef();
+
+  bool LInf = LHS->isMinusInf() || LHS->isPlusInf(),
+       RInf = RHS->isMinusInf() || RHS->isPlusInf();
+  if (RInf)
+    return LInf ? getUndef() : getInt(0);
+
+  if (RHS->isInt()) {
+    int64_t Div = RHS->getInt();
+    if (Div == 0)
+      return getUndef();
+    if (LInf || Div == 1 || Div == -1)
+      return getScaled(LHS, Div > 0 ? 1 : -1);
+    if (LHS->isInt())
+      return getInt(LHS->getInt() / Div);
+
+    // Divide term by term if the division is exact for every term.
+    int64_t Int;
+    SmallVector<Term, 4> Terms;
+    Decompose(LHS, Int, Terms);
+    bool Exact = Int % Div == 0;
+    for (auto &T : Terms)
+      Exact = Exact && T.second % Div == 0;
+    if (Exact) {
+      for (auto &T : Terms)
+        T.second /= Div;
+      return getLinear(Int / Div, Terms);
+    }
+  }
+
+  if (LInf)
+    return getUndef();
+
+  const NativeNode *Ops[] = { LHS, RHS };
+  return getNode(NativeNode::NK_Div, 0, StringRef(), Ops, ArrayRef<int64_t>());
+}
+
+const NativeNode *NativeContext::computeMinMax(NativeNode::NodeKind Kind,
+                                               const NativeNode *LHS,
+                                               const NativeNode *RHS) {
+  bool IsMin = Kind == NativeNode::NK_Min;
+  if (LHS->isUndef() || RHS->isUndef())
+    return getUndef();
+
+  // -oo absorbs mins and is the identity of maxes, and vice-versa for +oo.
+  for (auto N : { LHS, RHS })
+    if (IsMin ? N->isMinusInf() : N->isPlusInf())
+      return N;
+  if (IsMin ? LHS->isPlusInf() : LHS->isMinusInf())
+    return RHS;
+  if (IsMin ? RHS->isPlusInf() : RHS->isMinusInf())
+    return LHS;
+
+  SmallVector<const NativeNode*, 4> Ops;
+  const NativeNode *Int = nullptr;
+  for (auto N : { LHS, RHS }) {
+    ArrayRef<const NativeNode*> Args =
+        N->getKind() == Kind ? N->getOps() : ArrayRef<const NativeNode*>(N);
+    for (auto Arg : Args)
+      if (!Arg->isInt())
+        Ops.push_back(Arg);
+      else if (!Int || (IsMin ? Arg->getInt() < Int->getInt()
+                              : Arg->getInt() > Int->getInt()))
+        Int = Arg;
+  }
+  if (Int)
+    Ops.push_back(Int);
+
+  std::sort(Ops.begin(), Ops.end(), CompareIDs);
+  Ops.erase(std::unique(Ops.begin(), Ops.end()), Ops.end());
+
+  // Drop the operands that another one subsumes, such as a in max(a, a + 1),
+  // one at a time so that the subsuming operand is always kept. This keeps
+  // the chains built by meets from growing with every incoming value.
+  for (unsigned Idx = 0; Idx < Ops.size() && Ops.size() > 1; ) {
+    bool Subsumed = false;
+    for (unsigned Other = 0; Other < Ops.size() && !Subsumed; ++Other)
+      Subsumed = Other != Idx && (IsMin ? isKnownLE(Ops[Other], Ops[Idx])
+                                        : isKnownLE(Ops[Idx], Ops[Other]));
+    if (Subsumed)
+      Ops.erase(Ops.begin() + Idx);
+    else
+      ++Idx;
+  }
+  if (Ops.size() == 1)
+    return Ops[0];
+
+  return getNode(Kind, 0, StringRef(), Ops, ArrayRef<int64_t>());
+}
+
+const NativeNode *NativeContext::getOp(OpKind Op, const NativeNode *LHS,
+                                       const NativeNode *RHS) {
+  // Normalize the operand order of commutative operations.
+  if (Op != OK_Div && RHS && CompareIDs(RHS, LHS))
+    std::swap(LHS, RHS);
+
+  auto Key = std::make_pair((unsigned) Op, std::make_pair(LHS, RHS));
+  auto It = Ops_.find(Key);
+  if (It != Ops_.end())
+    return It->second;
+
+  const NativeNode *Ret = nullptr;
+  switch (Op) {
+    case OK_Add: Ret = computeAdd(LHS, RHS);                        break;
+    case OK_Neg: Ret = getScaled(LHS, -1);                          break;
+    case OK_Mul: Ret = computeMul(LHS, RHS);                        break;
+    case OK_Div: Ret = computeDiv(LHS, RHS);                        break;
+    case OK_Min: Ret = computeMinMax(NativeNode::NK_Min, LHS, RHS); break;
+    case OK_Max: Ret = computeMinMax(NativeNode::NK_Max, LHS, RHS); break;
+  }
+
+  // The computation may have grown the table, so insert anew.
+  Ops_[Key] = Ret;
+  return Ret;
+}
+
+const NativeNode *NativeContext::getAdd(const NativeNode *LHS,
+                                        const NativeNode *RHS) {
+  return getOp(OK_Add, LHS, RHS);
+}
+
+const NativeNode *NativeContext::getNeg(const NativeNode *N) {
+  return getOp(OK_Neg, N, nullptr);
+}
+
+const NativeNode *NativeContext::getMul(const NativeNode *LHS,
+                                        const NativeNode *RHS) {
+  return getOp(OK_Mul, LHS, RHS);
+}
+
+const NativeNode *NativeContext::getDiv(const NativeNode *LHS,
+                                        const NativeNode *RHS) {
+  return getOp(OK_Div, LHS, RHS);
+}
+
+const NativeNode *NativeContext::getMin(const NativeNode *LHS,
+                                        const NativeNode *RHS) {
+  return getOp(OK_Min, LHS, RHS);
+}
+
+const NativeNode *NativeContext::getMax(const NativeNode *LHS,
+                                        const NativeNode *RHS) {
+  return getOp(OK_Max, LHS, RHS);
+}
+
+const NativeRangeNode *NativeContext::getRange(const NativeNode *Lower,
+                                               const NativeNode *Upper) {
+  const NativeRangeNode *&Node = Ranges_[std::make_pair(Lower, Upper)];
+  if (!Node) {
+    NativeRangeNode *N = Alloc_.Allocate<NativeRangeNode>();
+    N->Lower = Lower;
+    N->Upper = Upper;
+    Node = N;
+  }
+  return Node;
+}
+
+// Linear terms are canonical and every other node is uniqued, so the
+// difference of two distinct nodes never folds to zero: identity is equality.
+bool NativeContext::isKnownEQ(const NativeNode *LHS, const NativeNode *RHS) {
+  return LHS == RHS && !LHS->isUndef();
+}
+
+bool NativeContext::isKnownLT(const NativeNode *LHS, const NativeNode *RHS) {
+  return isKnownBelow(LHS, RHS, /*Strict=*/true);
+}
+
+bool NativeContext::isKnownLE(const NativeNode *LHS, const NativeNode *RHS) {
+  return isKnownBelow(LHS, RHS, /*Strict=*/false);
+}
+
+// Beyond constant differences, a min is below what any of its operands is
+// below and a max is below what all of its operands are below, and
+// symmetrically for the right-hand side.
+bool NativeContext::isKnownBelow(const NativeNode *LHS, const NativeNode *RHS,
+                                 bool Strict) {
+  if (LHS->isUndef() || RHS->isUndef())
+    return false;
+  if (LHS == RHS)
+    return !Strict;
+  if (LHS->isMinusInf() || RHS->isPlusInf())
+    return true;
+  if (LHS->isPlusInf() || RHS->isMinusInf())
+    return false;
+
+  if (LHS->getKind() == NativeNode::NK_Min ||
+      LHS->getKind() == NativeNode::NK_Max) {
+    bool IsMin = LHS->getKind() == NativeNode::NK_Min;
+    for (auto Op : LHS->getOps())
+      if (isKnownBelow(Op, RHS, Strict) == IsMin)
+        return IsMin;
+    return !IsMin;
+  }
+  if (RHS->getKind() == NativeNode::NK_Min ||
+      RHS->getKind() == NativeNode::NK_Max) {
+    bool IsMax = RHS->getKind() == NativeNode::NK_Max;
+    for (auto Op : RHS->getOps())
+      if (isKnownBelow(LHS, Op, Strict) == IsMax)
+        return IsMax;
+    return !IsMax;
+  }
+
+  const NativeNode *Diff = getSub(LHS, RHS);
+  return Diff->isInt() && (Strict ? Diff->getInt() < 0 : Diff->getInt() <= 0);
+}
+
+const NativeNode *NativeContext::substitute(
+    const NativeNode *N, const StringMap<const NativeRangeNode*> &Subst,
+    bool Upper) {
+  const NativeNode *Inf = Upper ? getPlusInf() : getMinusInf();
+  switch (N->getKind()) {
+    case NativeNode::NK_Int:
+      return getInt(N->getInt());
+    case NativeNode::NK_MinusInf:
+      return getMinusInf();
+    case NativeNode::NK_PlusInf:
+      return getPlusInf();
+    case NativeNode::NK_Undef:
+      return getUndef();
+    case NativeNode::NK_Sym: {
+      auto It = Subst.find(N->getName());
+      if (It == Subst.end())
+        return Inf;
+      return Upper ? It->second->Upper : It->second->Lower;
+    }
+    case NativeNode::NK_Add: {
+      // A negative coefficient flips the bound taken from its operand.
+      const NativeNode *Ret = getInt(N->getInt());
+      for (unsigned Idx = 0; Idx < N->getOps().size(); ++Idx) {
+        int64_t Coeff = N->getCoeffs()[Idx];
+        const NativeNode *Op =
+            substitute(N->getOps()[Idx], Subst, Upper != (Coeff < 0));
+        Ret = getAdd(Ret, getMul(Op, getInt(Coeff)));
+      }
+      return Ret;
+    }
+    case NativeNode::NK_Min:
+    case NativeNode::NK_Max: {
+      const NativeNode *Ret = nullptr;
+      for (auto Op : N->getOps()) {
+        const NativeNode *Sub = substitute(Op, Subst, Upper);
+        if (!Ret)
+          Ret = Sub;
+        else if (N->getKind() == NativeNode::NK_Min)
+          Ret = getMin(Ret, Sub);
+        else
+          Ret = getMax(Ret, Sub);
+      }
+      return Ret;
+    }
+    case NativeNode::NK_Mul:
+    case NativeNode::NK_Div: {
+      // The sign of the operands is unknown, so only exact substitutions
+      // are kept.
+      const NativeNode *Ret = nullptr;
+      for (auto Op : N->getOps()) {
+        const NativeNode *Sub = substitute(Op, Subst, false);
+        if (Sub != substitute(Op, Subst, true) || Sub->isMinusInf() ||
+            Sub->isPlusInf())
+          return Inf;
+        if (!Ret)
+          Ret = Sub;
+        else if (N->getKind() == NativeNode::NK_Mul)
+          Ret = getMul(Ret, Sub);
+        else
+          Ret = getDiv(Ret, Sub);
+      }
+      return Ret;
+    }
+  }
+  llvm_unreachable("Unknown node kind");
+}
+
+//===----------------------------------------------------------------------===//
+// NativeExpr
+//===----------------------------------------------------------------------===//
+
+NativeExpr::NativeExpr(NativeContext &Ctx, int64_t Int)
+    : Ctx_(&Ctx), Node_(Ctx.getInt(Int)) {
+}
+
+NativeExpr::NativeExpr(NativeContext &Ctx, const char *Name)
+    : Ctx_(&Ctx), Node_(Ctx.getSym(Name)) {
+}
+
+NativeExpr::NativeExpr(NativeContext &Ctx, const std::string &Name)
+    : Ctx_(&Ctx), Node_(Ctx.getSym(Name)) {
+}
+
+NativeExpr NativeExpr::getMinusInf(NativeContext &Ctx) {
+  return NativeExpr(Ctx, Ctx.getMinusInf());
+}
+
+NativeExpr NativeExpr::getPlusInf(NativeContext &Ctx) {
+  return NativeExpr(Ctx, Ctx.getPlusInf());
+}
+
+NativeExpr NativeExpr::operator+(const NativeExpr &Other) const {
+  return NativeExpr(*Ctx_, Ctx_->getAdd(Node_, Other.Node_));
+}
+
+NativeExpr NativeExpr::operator-(const NativeExpr &Other) const {
+  return NativeExpr(*Ctx_, Ctx_->getSub(Node_, Other.Node_));
+}
+
+NativeExpr NativeExpr::operator*(const NativeExpr &Other) const {
+  return NativeExpr(*Ctx_, Ctx_->getMul(Node_, Other.Node_));
+}
+
+NativeExpr NativeExpr::operator/(const NativeExpr &Other) const {
+  return NativeExpr(*Ctx_, Ctx_->getDiv(Node_, Other.Node_));
+}
+
+NativeExpr NativeExpr::operator+(int64_t Other) const {
+  return NativeExpr(*Ctx_, Ctx_->getAdd(Node_, Ctx_->getInt(Other)));
+}
+
+NativeExpr NativeExpr::operator-(int64_t Other) const {
+  return NativeExpr(*Ctx_, Ctx_->getSub(Node_, Ctx_->getInt(Other)));
+}
+
+NativeExpr NativeExpr::operator*(int64_t Other) const {
+  return NativeExpr(*Ctx_, Ctx_->getMul(Node_, Ctx_->getInt(Other)));
+}
+
+NativeExpr NativeExpr::operator/(int64_t Other) const {
+  return NativeExpr(*Ctx_, Ctx_->getDiv(Node_, Ctx_->getInt(Other)));
+}
+
+NativeExpr NativeExpr::operator-() const {
+  return NativeExpr(*Ctx_, Ctx_->getNeg(Node_));
+}
+
+NativeExpr NativeExpr::min(const NativeExpr &Other) const {
+  return NativeExpr(*Ctx_, Ctx_->getMin(Node_, Other.Node_));
+}
+
+NativeExpr NativeExpr::max(const NativeExpr &Other) const {
+  return NativeExpr(*Ctx_, Ctx_->getMax(Node_, Other.Node_));
+}
+
+bool NativeExpr::isEQ(const NativeExpr &Other) const {
+  return Ctx_->isKnownEQ(Node_, Other.Node_);
+}
+
+bool NativeExpr::isNE(const NativeExpr &Other) const {
+  return !isEQ(Other);
+}
+
+bool NativeExpr::isLT(const NativeExpr &Other) const {
+  return Ctx_->isKnownLT(Node_, Other.Node_);
+}
+
+bool NativeExpr::isLE(const NativeExpr &Other) const {
+  return Ctx_->isKnownLE(Node_, Other.Node_);
+}
+
+bool NativeExpr::isGT(const NativeExpr &Other) const {
+  return Other.isLT(*this);
+}
+
+bool NativeExpr::isGE(const NativeExpr &Other) const {
+  return Other.isLE(*this);
+}
+
+// Symbols used by -sra-use-sym-bounds for the limits of each integer type.
+static Value *GetLimit(IntegerType *Ty, StringRef Name) {
+  static const struct {
+    const char *Name;
+    unsigned Width;
+    bool IsSigned;
+  } Limits[] = {
+    { "CHAR_MIN",  8,  true  }, { "UCHAR_MAX", 8,  false },
+    { "SHRT_MIN",  16, true  }, { "USHRT_MAX", 16, false },
+    { "INT_MIN",   32, true  }, { "UINT_MAX",  32, false },
+    { "LONG_MIN",  64, true  }, { "ULONG_MAX", 64, false },
+  };
+
+  for (auto &Limit : Limits)
+    if (Name == Limit.Name) {
+      APInt Val = Limit.IsSigned
+          ? APInt::getSignedMinValue(Limit.Width)
+                .sextOrTrunc(Ty->getBitWidth())
+          : APInt::getMaxValue(Limit.Width).zextOrTrunc(Ty->getBitWidth());
+      return ConstantInt::get(Ty, Val);
+    }
+  return nullptr;
+}
+
+static Value *Materialize(const NativeNode *N, IntegerType *Ty,
+                          IRBuilder<> &IRB,
+                          const std::map<std::string, Value*> &Mapping,
+                          NativeValueCache *Cache);
+
+static Value *MaterializeNode(const NativeNode *N, IntegerType *Ty,
+                              IRBuilder<> &IRB,
+                              const std::map<std::string, Value*> &Mapping,
+                              NativeValueCache *Cache) {
+  unsigned Width = Ty->getBitWidth();
+  switch (N->getKind()) {
+    case NativeNode::NK_Int:
+      return ConstantInt::getSigned(Ty, N->getInt());
+    case NativeNode::NK_Sym: {
+      auto It = Mapping.find(N->getName().str());
+      if (It != Mapping.end())
+        return IRB.CreateSExtOrTrunc(It->second, Ty);
+      Value *Limit = GetLimit(Ty, N->getName());
+      assert(Limit && "Symbol has no associated value");
+      return Limit ? Limit : UndefValue::get(Ty);
+    }
+    case NativeNode::NK_MinusInf:
+      return ConstantInt::get(Ty, APInt::getSignedMinValue(Width));
+    case NativeNode::NK_PlusInf:
+      return ConstantInt::get(Ty, APInt::getMaxValue(Width));
+    case NativeNode::NK_Undef:
+      return UndefValue::get(Ty);
+    case NativeNode::NK_Add: {
+      Value *Ret = nullptr;
+      auto Ops = N->getOps();
+      auto Coeffs = N->getCoeffs();
+      for (unsigned Idx = 0; Idx < Ops.size(); ++Idx) {
+        Value *Op = Materialize(Ops[Idx], Ty, IRB, Mapping, Cache);
+        if (Coeffs[Idx] == -1) {
+          Ret = Ret ? IRB.CreateSub(Ret, Op) : IRB.CreateNeg(Op);
+          continue;
+        }
+        if (Coeffs[Idx] != 1)
+          Op = IRB.CreateMul(Op, ConstantInt::getSigned(Ty, Coeffs[Idx]));
+        Ret = Ret ? IRB.CreateAdd(Ret, Op) : Op;
+      }
+      if (N->getInt() != 0)
+        Ret = IRB.CreateAdd(Ret, ConstantInt::getSigned(Ty, N->getInt()));
+      return Ret;
+    }
+    case NativeNode::NK_Mul: {
+      Value *Ret = nullptr;
+      for (auto Op : N->getOps()) {
+        Value *Factor = Materialize(Op, Ty, IRB, Mapping, Cache);
+        Ret = Ret ? IRB.CreateMul(Ret, Factor) : Factor;
+      }
+      return Ret;
+    }
+    case NativeNode::NK_Div:
+      return IRB.CreateSDiv(
+          Materialize(N->getOps()[0], Ty, IRB, Mapping, Cache),
+          Materialize(N->getOps()[1], Ty, IRB, Mapping, Cache));
+    case NativeNode::NK_Min:
+    case NativeNode::NK_Max: {
+      bool IsMin = N->getKind() == NativeNode::NK_Min;
+      Value *Ret = nullptr;
+      for (auto Op : N->getOps()) {
+        Value *Arg = Materialize(Op, Ty, IRB, Mapping, Cache);
+        if (!Ret) {
+          Ret = Arg;
+          continue;
+        }
+        Value *Cmp = IsMin ? IRB.CreateICmpSLT(Ret, Arg)
+                           : IRB.CreateICmpSGT(Ret, Arg);
+        Ret = IRB.CreateSelect(Cmp, Ret, Arg);
+      }
+      return Ret;
+    }
+  }
+  llvm_unreachable("Unknown node kind");
+}
+
+// Identical subexpressions are shared through the cache, which also holds any
+// existing values the caller knows to be equal to a node.
+static Value *Materialize(const NativeNode *N, IntegerType *Ty,
+                          IRBuilder<> &IRB,
+                          const std::map<std::string, Value*> &Mapping,
+                          NativeValueCache *Cache) {
+  if (!Cache)
+    return MaterializeNode(N, Ty, IRB, Mapping, Cache);
+
+  auto Key = std::make_pair(N, (Type*) Ty);
+  auto It = Cache->find(Key);
+  if (It != Cache->end() && It->second)
+    return It->second;
+
+  Value *Ret = MaterializeNode(N, Ty, IRB, Mapping, Cache);
+  (*Cache)[Key] = Ret;
+  return Ret;
+}
+
+Value *NativeExpr::toValue(IntegerType *Ty, IRBuilder<> &IRB,
+                           const std::map<std::string, Value*> &Mapping,
+                           Module *) const {
+  return Materialize(Node_, Ty, IRB, Mapping, nullptr);
+}
+
+Value *NativeExpr::toValue(IntegerType *Ty, IRBuilder<> &IRB,
+                           const std::map<std::string, Value*> &Mapping,
+                           NativeValueCache &Cache) const {
+  return Materialize(Node_, Ty, IRB, Mapping, &Cache);
+}
+
+//===----------------------------------------------------------------------===//
+// NativeRange
+//===----------------------------------------------------------------------===//
+
+// Bounds that cannot be computed (e.g. +oo - +oo) are widened to -oo/+oo.
+static NativeRange MakeRange(NativeExpr Lower, NativeExpr Upper) {
+  if (Lower.isUndef())
+    Lower = NativeExpr::getMinusInf(Lower.getContext());
+  if (Upper.isUndef())
+    Upper = NativeExpr::getPlusInf(Upper.getContext());
+  return NativeRange(Lower, Upper);
+}
+
+NativeRange::NativeRange(NativeExpr Expr)
+    : Ctx_(&Expr.getContext()),
+      Node_(Ctx_->getRange(Expr.getNode(), Expr.getNode())) {
+}
+
+NativeRange::NativeRange(NativeExpr Lower, NativeExpr Upper)
+    : Ctx_(&Lower.getContext()),
+      Node_(Ctx_->getRange(Lower.getNode(), Upper.getNode())) {
+}
+
+void NativeRange::setLower(NativeExpr Lower) {
+  Node_ = Ctx_->getRange(Lower.getNode(), Node_->Upper);
+}
+
+void NativeRange::setUpper(NativeExpr Upper) {
+  Node_ = Ctx_->getRange(Node_->Lower, Upper.getNode());
+}
+
+NativeRange NativeRange::operator+(const NativeRange &Other) const {
+  return MakeRange(getLower() + Other.getLower(),
+                   getUpper() + Other.getUpper());
+}
+
+NativeRange NativeRange::operator-(const NativeRange &Other) const {
+  return MakeRange(getLower() - Other.getUpper(),
+                   getUpper() - Other.getLower());
+}
+
+NativeRange NativeRange::operator*(const NativeRange &Other) const {
+  NativeExpr LL = getLower() * Other.getLower(),
+             LU = getLower() * Other.getUpper(),
+             UL = getUpper() * Other.getLower(),
+             UU = getUpper() * Other.getUpper();
+  return MakeRange(LL.min(LU).min(UL.min(UU)), LL.max(LU).max(UL.max(UU)));
+}
+
+NativeRange NativeRange::operator/(const NativeRange &Other) const {
+  NativeExpr Zero(*Ctx_, (int64_t) 0);
+  if (Other.getLower().isLE(Zero) && Other.getUpper().isGE(Zero))
+    return MakeRange(NativeExpr::getMinusInf(*Ctx_),
+                     NativeExpr::getPlusInf(*Ctx_));
+
+  NativeExpr LL = getLower() / Other.getLower(),
+             LU = getLower() / Other.getUpper(),
+             UL = getUpper() / Other.getLower(),
+             UU = getUpper() / Other.getUpper();
+  return MakeRange(LL.min(LU).min(UL.min(UU)), LL.max(LU).max(UL.max(UU)));
+}
+
+void NativeRange::print(raw_ostream &OS) const {
+  OS << "[" << getLower() << ", " << getUpper() << "]";
+}
+
+raw_ostream& operator<<(raw_ostream& OS, const NativeExpr& Expr) {
+  Expr.print(OS);
+  return OS;
+}
+
+raw_ostream& operator<<(raw_ostream& OS, const NativeRange& Range) {
+  Range.print(OS);
+  return OS;
+}
+
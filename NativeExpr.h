@@ -0,0 +1,272 @@
+#ifndef _NATIVEEXPR_H_
+#define _NATIVEEXPR_H_
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/FoldingSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <string>
+
+using namespace llvm;
+
+class NativeContext;
+
+// A node of a symbolic bound. Nodes are uniqued by their NativeContext, so two
+// structurally identical expressions are always represented by the same node.
+//
+// Linear expressions are kept in a canonical form: an NK_Add node holds a
+// constant term plus a list of (operand, coefficient) pairs, where no operand
+// is itself an integer or an NK_Add node. Operands of commutative nodes are
+// sorted by their creation ID.
+class NativeNode : public FoldingSetNode {
+public:
+  enum NodeKind {
+    NK_Int, NK_Sym, NK_MinusInf, NK_PlusInf, NK_Undef,
+    NK_Add, NK_Mul, NK_Div, NK_Min, NK_Max
+  };
+
+  NodeKind getKind() const { return Kind_; }
+  unsigned getID()   const { return ID_;   }
+  unsigned getSize() const { return Size_; }
+
+  // The value of an NK_Int node, or the constant term of an NK_Add node.
+  int64_t getInt() const { return Int_; }
+
+  // The name of an NK_Sym node.
+  StringRef getName() const { return Name_; }
+
+  ArrayRef<const NativeNode*> getOps() const {
+    return ArrayRef<const NativeNode*>(Ops_, NumOps_);
+  }
+
+  // The coefficient of each operand of an NK_Add node.
+  ArrayRef<int64_t> getCoeffs() const {
+    return ArrayRef<int64_t>(Coeffs_, Coeffs_ ? NumOps_ : 0);
+  }
+
+  bool isInt()      const { return Kind_ == NK_Int;      }
+  bool isMinusInf() const { return Kind_ == NK_MinusInf; }
+  bool isPlusInf()  const { return Kind_ == NK_PlusInf;  }
+  bool isUndef()    const { return Kind_ == NK_Undef;    }
+
+  void Profile(FoldingSetNodeID &ID) const;
+  void print(raw_ostream &OS) const;
+
+  static void Profile(FoldingSetNodeID &ID, NodeKind Kind, int64_t Int,
+                      StringRef Name, ArrayRef<const NativeNode*> Ops,
+                      ArrayRef<int64_t> Coeffs);
+
+private:
+  friend class NativeContext;
+
+  NativeNode(NodeKind Kind, unsigned ID, int64_t Int, StringRef Name,
+             const NativeNode **Ops, const int64_t *Coeffs, unsigned NumOps);
+
+  NodeKind Kind_;
+  unsigned ID_;
+  unsigned Size_;
+  int64_t  Int_;
+  StringRef Name_;
+  const NativeNode **Ops_;
+  const int64_t     *Coeffs_;
+  unsigned           NumOps_;
+};
+
+// An interned pair of bounds. Identical ranges share a single NativeRangeNode,
+// so comparing two ranges is a single pointer comparison.
+struct NativeRangeNode {
+  const NativeNode *Lower, *Upper;
+};
+
+// Owns and uniques every NativeNode and NativeRangeNode. All arithmetic is
+// performed here, so that results are built directly in canonical form, and
+// memoized, so that repeating an operation on the same operands is a single
+// hash table lookup. A context is not thread-safe; concurrent analyses each
+// use their own.
+class NativeContext {
+public:
+  NativeContext() : NextID_(0) { }
+
+  const NativeNode *getInt(int64_t Int);
+  const NativeNode *getSym(StringRef Name);
+  const NativeNode *getMinusInf();
+  const NativeNode *getPlusInf();
+  const NativeNode *getUndef();
+
+  const NativeNode *getAdd(const NativeNode *LHS, const NativeNode *RHS);
+  const NativeNode *getSub(const NativeNode *LHS, const NativeNode *RHS);
+  const NativeNode *getNeg(const NativeNode *N);
+  const NativeNode *getMul(const NativeNode *LHS, const NativeNode *RHS);
+  const NativeNode *getDiv(const NativeNode *LHS, const NativeNode *RHS);
+  const NativeNode *getMin(const NativeNode *LHS, const NativeNode *RHS);
+  const NativeNode *getMax(const NativeNode *LHS, const NativeNode *RHS);
+
+  const NativeRangeNode *getRange(const NativeNode *Lower,
+                                  const NativeNode *Upper);
+
+  // Returns true if LHS - RHS is known to have the given sign.
+  bool isKnownEQ(const NativeNode *LHS, const NativeNode *RHS);
+  bool isKnownLT(const NativeNode *LHS, const NativeNode *RHS);
+  bool isKnownLE(const NativeNode *LHS, const NativeNode *RHS);
+
+  // Rebuilds N, which may belong to another context, in this one, replacing
+  // each symbol named in Subst by its lower bound, or by its upper bound if
+  // Upper is set. The result bounds N from below (or above) wherever N is
+  // monotonic in the replaced symbols; any other symbol, and any product or
+  // quotient over a symbol that is not replaced by a single value, makes it
+  // the corresponding infinity instead.
+  const NativeNode *substitute(const NativeNode *N,
+                               const StringMap<const NativeRangeNode*> &Subst,
+                               bool Upper);
+
+private:
+  NativeContext(const NativeContext&) = delete;
+  void operator=(const NativeContext&) = delete;
+
+  enum OpKind { OK_Add, OK_Neg, OK_Mul, OK_Div, OK_Min, OK_Max };
+
+  typedef std::pair<const NativeNode*, int64_t> Term;
+  typedef std::pair<const NativeNode*, const NativeNode*> NodePair;
+
+  const NativeNode *getOp(OpKind Op, const NativeNode *LHS,
+                          const NativeNode *RHS);
+  const NativeNode *computeAdd(const NativeNode *LHS, const NativeNode *RHS);
+  const NativeNode *computeMul(const NativeNode *LHS, const NativeNode *RHS);
+  const NativeNode *computeDiv(const NativeNode *LHS, const NativeNode *RHS);
+
+  const NativeNode *getNode(NativeNode::NodeKind Kind, int64_t Int,
+                            StringRef Name, ArrayRef<const NativeNode*> Ops,
+                            ArrayRef<int64_t> Coeffs);
+  const NativeNode *getLinear(int64_t Int, SmallVectorImpl<Term> &Terms);
+  const NativeNode *getScaled(const NativeNode *N, int64_t Factor);
+  const NativeNode *computeMinMax(NativeNode::NodeKind Kind,
+                                  const NativeNode *LHS,
+                                  const NativeNode *RHS);
+  bool isKnownBelow(const NativeNode *LHS, const NativeNode *RHS, bool Strict);
+
+  FoldingSet<NativeNode> Nodes_;
+  BumpPtrAllocator       Alloc_;
+  unsigned               NextID_;
+
+  DenseMap<std::pair<unsigned, NodePair>, const NativeNode*> Ops_;
+  DenseMap<NodePair, const NativeRangeNode*>                 Ranges_;
+};
+
+// Values materialized for (node, type) pairs, valid at a single insertion
+// point. Entries are cleared if their value is deleted.
+typedef DenseMap<std::pair<const NativeNode*, Type*>, WeakVH> NativeValueCache;
+
+// Value handle for a symbolic bound, mirroring the interface of SAGEExpr.
+class NativeExpr {
+public:
+  NativeExpr(NativeContext &Ctx, int64_t Int);
+  NativeExpr(NativeContext &Ctx, const char *Name);
+  NativeExpr(NativeContext &Ctx, const std::string &Name);
+  NativeExpr(NativeContext &Ctx, const NativeNode *Node)
+      : Ctx_(&Ctx), Node_(Node) { }
+
+  static NativeExpr getMinusInf(NativeContext &Ctx);
+  static NativeExpr getPlusInf(NativeContext &Ctx);
+
+  bool isMinusInf() const { return Node_->isMinusInf(); }
+  bool isPlusInf()  const { return Node_->isPlusInf();  }
+  bool isConstant() const { return Node_->isInt();      }
+  bool isUndef()    const { return Node_->isUndef();    }
+  int64_t getInteger() const { return Node_->getInt(); }
+
+  NativeExpr operator+(const NativeExpr &Other) const;
+  NativeExpr operator-(const NativeExpr &Other) const;
+  NativeExpr operator*(const NativeExpr &Other) const;
+  NativeExpr operator/(const NativeExpr &Other) const;
+  NativeExpr operator+(int64_t Other) const;
+  NativeExpr operator-(int64_t Other) const;
+  NativeExpr operator*(int64_t Other) const;
+  NativeExpr operator/(int64_t Other) const;
+  NativeExpr operator-() const;
+
+  NativeExpr min(const NativeExpr &Other) const;
+  NativeExpr max(const NativeExpr &Other) const;
+
+  // Nodes are uniqued, so identity is structural equality.
+  bool operator==(const NativeExpr &Other) const {
+    return Node_ == Other.Node_;
+  }
+  bool operator!=(const NativeExpr &Other) const {
+    return Node_ != Other.Node_;
+  }
+
+  bool isEQ(const NativeExpr &Other) const;
+  bool isNE(const NativeExpr &Other) const;
+  bool isLT(const NativeExpr &Other) const;
+  bool isLE(const NativeExpr &Other) const;
+  bool isGT(const NativeExpr &Other) const;
+  bool isGE(const NativeExpr &Other) const;
+
+  int getSize() const { return Node_->getSize(); }
+
+  // The module is only taken for compatibility with SAGEExpr.
+  Value *toValue(IntegerType *Ty, IRBuilder<> &IRB,
+                 const std::map<std::string, Value*> &Mapping,
+                 Module *M) const;
+  // As above, reusing and extending the values in Cache, which must belong to
+  // the insertion point of IRB.
+  Value *toValue(IntegerType *Ty, IRBuilder<> &IRB,
+                 const std::map<std::string, Value*> &Mapping,
+                 NativeValueCache &Cache) const;
+
+  NativeContext    &getContext() const { return *Ctx_; }
+  const NativeNode *getNode()    const { return Node_; }
+
+  void print(raw_ostream &OS) const { Node_->print(OS); }
+
+private:
+  NativeContext    *Ctx_;
+  const NativeNode *Node_;
+};
+
+// A pair of symbolic bounds, mirroring the interface of SAGERange.
+class NativeRange {
+public:
+  NativeRange(NativeExpr Expr);
+  NativeRange(NativeExpr Lower, NativeExpr Upper);
+
+  NativeExpr getLower() const { return NativeExpr(*Ctx_, Node_->Lower); }
+  NativeExpr getUpper() const { return NativeExpr(*Ctx_, Node_->Upper); }
+  void setLower(NativeExpr Lower);
+  void setUpper(NativeExpr Upper);
+
+  NativeRange operator+(const NativeRange &Other) const;
+  NativeRange operator-(const NativeRange &Other) const;
+  NativeRange operator*(const NativeRange &Other) const;
+  NativeRange operator/(const NativeRange &Other) const;
+
+  bool operator==(const NativeRange &Other) const {
+    return Node_ == Other.Node_;
+  }
+  bool operator!=(const NativeRange &Other) const {
+    return Node_ != Other.Node_;
+  }
+
+  const NativeRangeNode *getNode() const { return Node_; }
+
+  void print(raw_ostream &OS) const;
+
+private:
+  NativeContext         *Ctx_;
+  const NativeRangeNode *Node_;
+};
+
+raw_ostream& operator<<(raw_ostream& OS, const NativeExpr& Expr);
+raw_ostream& operator<<(raw_ostream& OS, const NativeRange& Range);
+
+#endif
+
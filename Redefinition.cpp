@@ -3,20 +3,25 @@
 
 #define DEBUG_TYPE "redef"
 
+#ifndef SRA_NATIVE_EXPR
 // Python.h should always be the first included file.
 #include "SAGE/Python/PythonInterface.h"
+#endif
 
 #include "Redefinition.h"
 
+#ifndef SRA_NATIVE_EXPR
 #include "SAGE/SAGEInterface.h"
+#endif
 
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 
-#include <list>
-#include <set>
+#include <algorithm>
 
 #if LLVM_VERSION_MINOR >= 7
 typedef LoopInfoWrapperPass LoopInfoPass;
@@ -27,6 +32,16 @@ typedef LoopInfo LoopInfoPass;
 STATISTIC(NumCreatedSigmas, "Number of sigma-phis created");
 STATISTIC(NumCreatedFrontierPhis, "Number of non-sigma-phis created");
 
+static cl::opt<bool>
+    Pruned("redef-pruned", cl::init(false), cl::Hidden,
+        cl::desc("Only redefine values that memory addresses are computed"
+            " from"));
+
+static cl::opt<bool>
+    Virtual("redef-virtual", cl::init(false), cl::Hidden,
+        cl::desc("Record redefinitions outside of the IR instead of inserting"
+            " them"));
+
 using namespace llvm;
 
 static RegisterPass<Redefinition> X("redef", "Integer live-range splitting");
@@ -46,152 +61,244 @@ static PHINode *CreateNamedPhi(Value *V, Twine Prefix,
 void Redefinition::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addRequired<DominatorTreeWrapperPass>();
   AU.addRequired<DominanceFrontier>();
+#ifndef SRA_NATIVE_EXPR
   AU.addPreserved<SAGEInterface>();
   AU.addPreserved<PythonInterface>();
+#endif
   AU.addPreserved<LoopInfoPass>();
   AU.setPreservesCFG();
+  if (Virtual)
+    AU.setPreservesAll();
 }
 
 bool Redefinition::runOnFunction(Function &F) {
   DT_  = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
   DF_  = &getAnalysis<DominanceFrontier>();
 
+  // Forget the redefinitions from a previous run on F.
+  auto KI = RedefKeys_.find(&F);
+  if (KI != RedefKeys_.end()) {
+    for (auto &Key : KI->second)
+      Redef_.erase(Key);
+    RedefKeys_.erase(KI);
+  }
+  auto VI = Virtual_.find(&F);
+  if (VI != Virtual_.end()) {
+    for (auto &Node : VI->second.Nodes)
+      Redefined_.erase(Node.get());
+    Virtual_.erase(VI);
+  }
+
+  if (Virtual)
+    Form_ = &Virtual_[&F];
   createSigmasInFunction(&F);
+  Form_ = nullptr;
 
-  for (auto &BB : F)
-    for (auto &I : BB)
-      if (PHINode *Phi = dyn_cast<PHINode>(&I))
-        if (Phi->getNumIncomingValues() == 1)
-          Redef_[&BB][Phi->getIncomingValue(0)] = Phi;
+  return !Virtual;
+}
 
-  return true;
+bool Redefinition::IsRedefinition(const Instruction *I) {
+  return isa<PHINode>(I) && I->getMetadata(GetKindName());
 }
 
 PHINode *Redefinition::getRedef(Value *V, BasicBlock *BB) {
-  auto BBIt = Redef_.find(BB);
-  if (BBIt == Redef_.end())
-    return nullptr;
-  auto Map = BBIt->second.find(V);
-  return Map != BBIt->second.end() ? Map->second : nullptr;
+  auto It = Redef_.find(std::make_pair(BB, V));
+  return It != Redef_.end() ? It->second : nullptr;
 }
 
-// Create sigma nodes for all branches in the function.
+bool Redefinition::isVirtual() const {
+  return Virtual;
+}
+
+Value *Redefinition::getDefAt(Value *V, BasicBlock *BB) const {
+  auto VI = Virtual_.find(BB->getParent());
+  if (VI == Virtual_.end())
+    return V;
+  auto &Reaching = VI->second.Reaching;
+  auto It = Reaching.find(std::make_pair(BB, V));
+  return It != Reaching.end() ? It->second : V;
+}
+
+ArrayRef<PHINode*> Redefinition::getVirtualRedefs(BasicBlock *BB) const {
+  auto VI = Virtual_.find(BB->getParent());
+  if (VI == Virtual_.end())
+    return None;
+  auto It = VI->second.Redefs.find(BB);
+  if (It == VI->second.Redefs.end())
+    return None;
+  return It->second;
+}
+
+// A virtual redefinition takes its value along every edge into its block.
+void Redefinition::getIncomingDefs(PHINode *Phi,
+                                   SmallVectorImpl<Value*> &Defs) const {
+  auto It = Redefined_.find(Phi);
+  if (It == Redefined_.end()) {
+    for (unsigned Idx = 0, E = Phi->getNumIncomingValues(); Idx != E; ++Idx)
+      Defs.push_back(getDefAt(Phi->getIncomingValue(Idx),
+                              Phi->getIncomingBlock(Idx)));
+    return;
+  }
+
+  Value *V = It->second.first;
+  BasicBlock *BB = It->second.second;
+  for (pred_iterator PI = pred_begin(BB), PE = pred_end(BB); PI != PE; ++PI)
+    Defs.push_back(getDefAt(V, *PI));
+}
+
+// Create sigma nodes for all branches in the function. The blocks in which
+// each value is redefined are gathered first, so that the uses of every value
+// are then renamed in a single pass.
 void Redefinition::createSigmasInFunction(Function *F) {
+  DT_->updateDFSNumbers();
+  UseBlocks_.clear();
+  Demanded_.clear();
+  if (Pruned)
+    collectDemandedValues(F);
+
+  SigmaSites Sites;
   for (auto& BB : *F) {
+    if (!DT_->isReachableFromEntry(&BB))
+      continue;
     // Rename operands used in conditional branches and their dependencies.
     TerminatorInst *TI = BB.getTerminator();
     if (BranchInst *BI = dyn_cast<BranchInst>(TI))
       if (BI->isConditional())
-        createSigmasForCondBranch(BI);
+        collectSigmasForCondBranch(BI, Sites);
+  }
+
+  for (auto &Site : Sites)
+    createRedefsForValue(Site.first, Site.second);
+  UseBlocks_.clear();
+}
+
+// Ranges are mostly asked for to bound memory accesses, so the pruned form
+// only redefines the integers that addresses, allocation sizes and memory
+// intrinsic lengths are computed from, through integer arithmetic, casts,
+// phis and selects.
+void Redefinition::collectDemandedValues(Function *F) {
+  std::vector<Value*> Worklist;
+  auto Demand = [&](Value *V) {
+    if (IsRedefinable(V) && Demanded_.insert(V).second)
+      Worklist.push_back(V);
+  };
+
+  for (auto &BB : *F)
+    for (auto &I : BB) {
+      if (auto GEP = dyn_cast<GetElementPtrInst>(&I))
+        for (auto &Idx : GEP->indices())
+          Demand(Idx);
+      else if (isa<IntToPtrInst>(I))
+        Demand(I.getOperand(0));
+      else if (auto AI = dyn_cast<AllocaInst>(&I))
+        Demand(AI->getArraySize());
+      else if (auto MI = dyn_cast<MemIntrinsic>(&I))
+        Demand(MI->getLength());
+    }
+
+  while (!Worklist.empty()) {
+    Instruction *I = dyn_cast<Instruction>(Worklist.back());
+    Worklist.pop_back();
+    if (!I)
+      continue;
+    if (isa<BinaryOperator>(I) || isa<CastInst>(I) || isa<PHINode>(I))
+      for (auto &Op : I->operands())
+        Demand(Op);
+    else if (auto SI = dyn_cast<SelectInst>(I)) {
+      Demand(SI->getTrueValue());
+      Demand(SI->getFalseValue());
+    }
   }
+
+  DEBUG(dbgs() << "collectDemandedValues: " << Demanded_.size()
+               << " values in " << F->getName() << "\n");
 }
 
-void Redefinition::createSigmasForCondBranch(BranchInst *BI) {
+void Redefinition::collectSigmasForCondBranch(BranchInst *BI,
+                                              SigmaSites &Sites) {
   assert(BI->isConditional() && "Expected conditional branch");
 
   ICmpInst *ICI = dyn_cast<ICmpInst>(BI->getCondition());
   if (!ICI || !ICI->getOperand(0)->getType()->isIntegerTy())
     return;
 
-  DEBUG(dbgs() << "createSigmasForCondBranch: " << *BI << "\n");
-
-  Value *Left = ICI->getOperand(0);
-  Value *Right = ICI->getOperand(1);
+  DEBUG(dbgs() << "collectSigmasForCondBranch: " << *BI << "\n");
 
   BasicBlock *TB = BI->getSuccessor(0);
   BasicBlock *FB = BI->getSuccessor(1);
 
-  bool HasSinglePredTB = TB->getSinglePredecessor() != nullptr;
-  bool HasSinglePredFB = FB->getSinglePredecessor() != nullptr;
-  bool IsRedefinableRight = IsRedefinable(Right);
-
-  if (IsRedefinable(Left)) {
-    // We don't want to place extranius definitions of a value, so only
-    // place the sigma once if the branch operands are the same.
-    Value *Second = Left != Right && IsRedefinableRight ? Right : nullptr;
-    if (HasSinglePredTB)
-      createSigmaNodesForValueAt(Left, Second, TB);
-    if (HasSinglePredFB)
-      createSigmaNodesForValueAt(Left, Second, FB);
-  }
-
-  if (IsRedefinableRight) {
-    if (HasSinglePredTB)
-      createSigmaNodesForValueAt(Right, nullptr, TB);
-    if (HasSinglePredFB)
-      createSigmaNodesForValueAt(Right, nullptr, FB);
-  }
+  // Blocks with several predecessors are not only reached through the
+  // branch. Both operands being the same value gets a single sigma.
+  for (Value *V : { ICI->getOperand(0), ICI->getOperand(1) })
+    if (IsRedefinable(V))
+      for (BasicBlock *BB : { TB, FB })
+        if (BB->getSinglePredecessor())
+          collectSigmaForValueAt(V, BB, Sites);
 }
 
-// Creates sigma nodes for the value and the transitive closure of its
-// dependencies.
-// To avoid extra redefinitions, we pass in both branch values so that the
-// and use the union of both redefinition sets.
-void Redefinition::createSigmaNodesForValueAt(Value *V, Value *C,
-                                              BasicBlock *BB) {
-  assert(BB->getSinglePredecessor() && "Block has multiple predecessors");
-
-  DEBUG(
-    dbgs() << "createSigmaNodesForValueAt: " << *V;
-    if (C) dbgs() << " and " << *C;
-    dbgs() << " at " << BB->getName() << "\n";
-  );
-
-  auto Position = BB->getFirstInsertionPt();
-  if (IsRedefinable(V) && dominatesUse(V, BB))
-     createSigmaNodeForValueAt(V, BB, Position);
-  if (C && IsRedefinable(C) && dominatesUse(C, BB))
-     createSigmaNodeForValueAt(C, BB, Position);
+void Redefinition::collectSigmaForValueAt(Value *V, BasicBlock *BB,
+                                          SigmaSites &Sites) {
+  if (Pruned && !Demanded_.count(V))
+    return;
+
+  auto &Blocks = Sites[V];
+  if (std::find(Blocks.begin(), Blocks.end(), BB) == Blocks.end() &&
+      dominatesUse(V, BB))
+    Blocks.push_back(BB);
 }
 
-void Redefinition::createSigmaNodeForValueAt(Value *V, BasicBlock *BB,
-                                             BasicBlock::iterator Position) {
-  DEBUG(dbgs() << "createSigmaNodeForValueAt: " << *V << "\n");
-
-  auto I = BB->begin();
-  while (!isa<PHINode>(&(*I)) && I != BB->end()) ++I;
-  while (isa<PHINode>(&(*I)) && I != BB->end()) {
-    PHINode *Phi = cast<PHINode>(&(*I));
-    if (Phi->getNumIncomingValues() == 1 &&
-        Phi->getIncomingValue(0) == V)
-      return;
-    ++I;
-  }
+// Creates the sigma nodes of V at Blocks, and phi nodes at the blocks in their
+// dominance frontiers that dominate a use of V, and then renames every use of
+// V to its closest dominating redefinition.
+void Redefinition::createRedefsForValue(Value *V,
+                                        ArrayRef<BasicBlock*> Blocks) {
+  if (Blocks.empty())
+    return;
 
-  PHINode *BranchRedef = CreateNamedPhi(V, GetRedefPrefix(), Position);
-  BranchRedef->addIncoming(V, BB->getSinglePredecessor());
-  NumCreatedSigmas++;
+  DEBUG(dbgs() << "createRedefsForValue: " << *V << " at " << Blocks.size()
+               << " blocks\n");
+
+  std::vector<std::pair<BasicBlock*, PHINode*>> Defs;
+  for (auto BB : Blocks)
+    Defs.push_back(std::make_pair(BB, createSigmaNodeAt(V, BB)));
 
-  std::list<PHINode*> FrontierRedefs;
-  // Phi nodes should be created on all blocks in the dominance frontier of BB
-  // where V is defined.
-  auto DI = DF_->find(BB);
-  if (DI != DF_->end())
-    for (auto& BI : DI->second)
+  SmallPtrSet<BasicBlock*, 8> Frontier;
+  for (auto BB : Blocks) {
+    auto DI = DF_->find(BB);
+    if (DI == DF_->end())
+      continue;
+    for (auto FB : DI->second)
       // If the block in the frontier dominates a use of V, then a phi node
       // should be created at said block.
-      if (dominatesUse(V, BI))
-         if (PHINode *FrontierRedef = createPhiNodeAt(V, BI)) {
-           FrontierRedefs.push_front(FrontierRedef);
-           // Replace all incoming definitions with the omega node for every
-           // predecessor where the omega node is defined.
-           for (auto PI = pred_begin(BI), PE = pred_end(BI); PI != PE; ++PI) {
-             if (DT_->dominates(BB, *PI)) {
-               FrontierRedef->removeIncomingValue(*PI);
-               FrontierRedef->addIncoming(BranchRedef, *PI);
-             }
-           }
-         }
-
-  // Replace all users of the V with the new sigma, starting at BB.
-  replaceUsesOfWithAfter(V, BranchRedef, BB);
-
-  // TODO: we should probably do replacing in reverse postorder.
-  for (auto &FrontierRedef : FrontierRedefs) {
-    replaceUsesOfWithAfter(FrontierRedef, BranchRedef, BB);
+      if (Frontier.insert(FB).second && dominatesUse(V, FB))
+        if (PHINode *Phi = createPhiNodeAt(V, FB))
+          Defs.push_back(std::make_pair(FB, Phi));
+  }
+
+  renameUses(V, Defs);
+
+  // Sigmas are found by the value that their block reads, which renaming
+  // may have replaced by a dominating redefinition of V.
+  for (unsigned Idx = 0, E = Blocks.size(); Idx != E; ++Idx) {
+    PHINode *Sigma = Defs[Idx].second;
+    RedefKey Key(Blocks[Idx], Virtual ? V : Sigma->getIncomingValue(0));
+    Redef_[Key] = Sigma;
+    RedefKeys_[Blocks[Idx]->getParent()].push_back(Key);
   }
 }
 
+PHINode *Redefinition::createSigmaNodeAt(Value *V, BasicBlock *BB) {
+  DEBUG(dbgs() << "createSigmaNodeAt: " << *V << " at " << BB->getName()
+               << "\n");
+
+  PHINode *Sigma =
+      createRedefAt(V, GetRedefPrefix(), BB, BB->getFirstInsertionPt());
+  if (!Virtual)
+    Sigma->addIncoming(V, BB->getSinglePredecessor());
+  NumCreatedSigmas++;
+  return Sigma;
+}
+
 // Creates a phi node for the given value at the given block.
 PHINode *Redefinition::createPhiNodeAt(Value *V, BasicBlock *BB) {
   assert(!V->getType()->isPointerTy() && "Value must not be a pointer");
@@ -200,58 +307,145 @@ PHINode *Redefinition::createPhiNodeAt(Value *V, BasicBlock *BB) {
                << BB->getName() << "\n");
 
   // Return null if V isn't defined on all predecessors of BB.
-  if (Instruction *I = dyn_cast<Instruction>(V))
+  if (Instruction *I = dyn_cast<Instruction>(V)) {
+    if (I->getParent() == BB)
+      return nullptr;
     for (pred_iterator PI = pred_begin(BB), PE = pred_end(BB); PI != PE; ++PI)
       if (!DT_->dominates(I->getParent(), *PI))
         return nullptr;
+  }
 
-  PHINode *Phi = CreateNamedPhi(V, GetPhiPrefix(), BB->begin());
-
-  // Add the default incoming values.
-  for (pred_iterator PI = pred_begin(BB), PE = pred_end(BB); PI != PE; ++PI)
-    Phi->addIncoming(V, *PI);
+  PHINode *Phi = createRedefAt(V, GetPhiPrefix(), BB, BB->begin());
 
-  // Replace all uses of V with the phi node, starting at BB.
-  replaceUsesOfWithAfter(V, Phi, BB);
+  // Add the default incoming values, which are renamed along with the other
+  // uses of V.
+  if (!Virtual)
+    for (pred_iterator PI = pred_begin(BB), PE = pred_end(BB); PI != PE; ++PI)
+      Phi->addIncoming(V, *PI);
 
   NumCreatedFrontierPhis++;
 
   return Phi;
 }
 
-// Returns true if BB dominates a use of V.
+// Virtual redefinitions are not in BB, so they are named after it to tell
+// them apart.
+PHINode *Redefinition::createRedefAt(Value *V, StringRef Prefix,
+                                     BasicBlock *BB,
+                                     BasicBlock::iterator Position) {
+  if (!Virtual) {
+    PHINode *Phi = CreateNamedPhi(V, Prefix, Position);
+    Phi->setMetadata(GetKindName(), MDNode::get(V->getContext(), None));
+    return Phi;
+  }
+
+  auto Name = (Prefix + "." + (V->hasName() ? V->getName() : "") + "." +
+               BB->getName()).str();
+  PHINode *Phi = PHINode::Create(V->getType(), 0, Name);
+  Form_->Nodes.emplace_back(Phi);
+  Form_->Redefs[BB].push_back(Phi);
+  Redefined_[Phi] = std::make_pair(V, BB);
+  return Phi;
+}
+
+// Returns true if BB dominates a use of V, that is, if the DFS number of a
+// use's block falls within the range of BB's subtree.
 bool Redefinition::dominatesUse(Value *V, BasicBlock *BB) {
+  DomTreeNode *Node = DT_->getNode(BB);
+  if (!Node)
+    return false;
+  auto &Blocks = getUseBlocks(V);
+  auto It = std::lower_bound(Blocks.begin(), Blocks.end(),
+                             Node->getDFSNumIn());
+  return It != Blocks.end() && *It <= Node->getDFSNumOut();
+}
+
+const std::vector<unsigned> &Redefinition::getUseBlocks(Value *V) {
+  auto It = UseBlocks_.find(V);
+  if (It != UseBlocks_.end())
+    return It->second;
+
+  std::vector<unsigned> Blocks;
   for (auto UI = V->user_begin(), UE = V->user_end(); UI != UE; ++UI)
     // Disregard phi nodes, since they can dominate their operands.
     if (isa<PHINode>(*UI) || V == *UI)
       continue;
     else if (Instruction *I = dyn_cast<Instruction>(*UI))
-      if (DT_->dominates(BB, I->getParent()))
-        return true;
-  return false;
+      if (DomTreeNode *Node = DT_->getNode(I->getParent()))
+        Blocks.push_back(Node->getDFSNumIn());
+  std::sort(Blocks.begin(), Blocks.end());
+  Blocks.erase(std::unique(Blocks.begin(), Blocks.end()), Blocks.end());
+  return UseBlocks_[V] = std::move(Blocks);
 }
 
-void Redefinition::replaceUsesOfWithAfter(Value *V, Value *R, BasicBlock *BB) {
-  DEBUG(dbgs() << "Redefinition: replaceUsesOfWithAfter: " << *V << " to "
-               << *R << " after " << BB->getName() << "\n");
-
-  std::set<Instruction*> Replace;
-  for (auto UI = V->user_begin(), UE = V->user_end(); UI != UE; ++UI)
-    if (Instruction *I = dyn_cast<Instruction>(*UI))
-      Replace.insert(I);
-
-  for (auto& I : Replace) {
-      // If the instruction's parent dominates BB, mark the instruction to
-      // be replaced.
-      if (I != R && DT_->dominates(BB, I->getParent()))
-        I->replaceUsesOfWith(V, R);
-      // If the parent does not dominate BB, check if the use is a phi and
-      // replace the incoming value later on.
-      else if (PHINode *Phi = dyn_cast<PHINode>(I))
-        for (unsigned Idx = 0; Idx < Phi->getNumIncomingValues(); ++Idx)
-          if (Phi->getIncomingValue(Idx) == V &&
-              DT_->dominates(BB, Phi->getIncomingBlock(Idx)))
-            Phi->setIncomingValue(Idx, R);
+// Every redefinition is a copy of V, so any dominating one may replace it;
+// each use takes the closest. A use by a phi happens at the end of the
+// incoming block, and redefinitions precede every other instruction of their
+// block; a frontier phi may thus take itself along a back edge. Defs and uses
+// are swept in dominator tree preorder, keeping the stack of definitions whose
+// subtree contains the current block. With -redef-virtual, the definition
+// reaching each use is recorded instead, as is the one reaching the end of
+// every predecessor of a redefinition, which it takes its value from.
+void Redefinition::renameUses(
+    Value *V, ArrayRef<std::pair<BasicBlock*, PHINode*>> Defs) {
+  DEBUG(dbgs() << "Redefinition: renameUses: " << *V << "\n");
+
+  typedef std::pair<DomTreeNode*, PHINode*> DefNode;
+  std::vector<DefNode> SortedDefs;
+  for (auto &Def : Defs)
+    SortedDefs.push_back(std::make_pair(DT_->getNode(Def.first), Def.second));
+
+  typedef std::pair<DomTreeNode*, Use*> UseNode;
+  std::vector<UseNode> SortedUses;
+  for (auto &U : V->uses()) {
+    Instruction *I = dyn_cast<Instruction>(U.getUser());
+    if (!I)
+      continue;
+    BasicBlock *BB = I->getParent();
+    if (PHINode *Phi = dyn_cast<PHINode>(I))
+      BB = Phi->getIncomingBlock(U);
+    // Uses in unreachable blocks keep V.
+    if (DomTreeNode *Node = DT_->getNode(BB))
+      SortedUses.push_back(std::make_pair(Node, &U));
+  }
+  if (Virtual)
+    for (auto &Def : Defs)
+      for (pred_iterator PI = pred_begin(Def.first), PE = pred_end(Def.first);
+           PI != PE; ++PI)
+        if (DomTreeNode *Node = DT_->getNode(*PI))
+          SortedUses.push_back(std::make_pair(Node, nullptr));
+
+  auto ByDFSNumIn = [](DomTreeNode *LHS, DomTreeNode *RHS) {
+    return LHS->getDFSNumIn() < RHS->getDFSNumIn();
+  };
+  std::sort(SortedDefs.begin(), SortedDefs.end(),
+            [&](const DefNode &LHS, const DefNode &RHS) {
+              return ByDFSNumIn(LHS.first, RHS.first);
+            });
+  std::stable_sort(SortedUses.begin(), SortedUses.end(),
+                   [&](const UseNode &LHS, const UseNode &RHS) {
+                     return ByDFSNumIn(LHS.first, RHS.first);
+                   });
+
+  std::vector<DefNode> Stack;
+  auto DI = SortedDefs.begin(), DE = SortedDefs.end();
+  for (auto &Use : SortedUses) {
+    unsigned In = Use.first->getDFSNumIn();
+    for (; DI != DE && DI->first->getDFSNumIn() <= In; ++DI) {
+      while (!Stack.empty() &&
+             Stack.back().first->getDFSNumOut() < DI->first->getDFSNumIn())
+        Stack.pop_back();
+      Stack.push_back(*DI);
+    }
+    while (!Stack.empty() && Stack.back().first->getDFSNumOut() < In)
+      Stack.pop_back();
+
+    if (Stack.empty())
+      continue;
+    if (Virtual)
+      Form_->Reaching[std::make_pair(Use.first->getBlock(), V)] =
+          Stack.back().second;
+    else
+      Use.second->set(Stack.back().second);
   }
 }
-
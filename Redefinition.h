@@ -2,39 +2,100 @@
 #define _REDEFINITION_H_
 
 #include "llvm/Pass.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Analysis/DominanceFrontier.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Instructions.h"
 
 #include <map>
+#include <memory>
+#include <vector>
 
 using namespace llvm;
 
 class Redefinition : public FunctionPass {
 public:
   static char ID;
-  Redefinition() : FunctionPass(ID) { }
+  Redefinition() : FunctionPass(ID), Form_(nullptr) { }
   virtual void getAnalysisUsage(AnalysisUsage &AU) const;
   virtual bool runOnFunction(Function &F);
 
   PHINode *getRedef(Value *V, BasicBlock *BB);
 
+  // With -redef-virtual, the IR is left untouched: redefinitions are phis
+  // outside of any block and without operands, and the uses they would take
+  // over are recorded instead. Otherwise, the queries below reflect the IR.
+  bool isVirtual() const;
+
+  // The definition of V read by the uses in BB, and by the phis that take V
+  // from BB: the virtual redefinition of V that dominates BB, or V itself.
+  Value *getDefAt(Value *V, BasicBlock *BB) const;
+
+  // The virtual redefinitions at the start of BB.
+  ArrayRef<PHINode*> getVirtualRedefs(BasicBlock *BB) const;
+
+  // The definitions merged by Phi, one per incoming edge.
+  void getIncomingDefs(PHINode *Phi, SmallVectorImpl<Value*> &Defs) const;
+
   static StringRef GetRedefPrefix() { return "redef"; }
   static StringRef GetPhiPrefix()   { return "phi";   }
 
+  // Redefinitions inserted in the IR carry metadata of this kind, which,
+  // unlike their names, is kept when value names are discarded.
+  static StringRef GetKindName() { return "redef"; }
+  static bool IsRedefinition(const Instruction *I);
+
 private:
+  // Blocks that get a sigma node for each value, in the order in which the
+  // values were first found.
+  typedef MapVector<Value*, SmallVector<BasicBlock*, 4>> SigmaSites;
+
   void createSigmasInFunction(Function *F);
-  void createSigmasForCondBranch(BranchInst *BI);
-  void createSigmaNodesForValueAt(Value *V, Value *P, BasicBlock *BB);
-  void createSigmaNodeForValueAt(Value *V, BasicBlock *BB,
-                                 BasicBlock::iterator Position);
+  void collectDemandedValues(Function *F);
+  void collectSigmasForCondBranch(BranchInst *BI, SigmaSites &Sites);
+  void collectSigmaForValueAt(Value *V, BasicBlock *BB, SigmaSites &Sites);
+  void createRedefsForValue(Value *V, ArrayRef<BasicBlock*> Blocks);
 
+  PHINode *createSigmaNodeAt(Value *V, BasicBlock *BB);
   PHINode *createPhiNodeAt(Value *V, BasicBlock *BB);
+  PHINode *createRedefAt(Value *V, StringRef Prefix, BasicBlock *BB,
+                         BasicBlock::iterator Position);
 
   bool dominatesUse(Value *V, BasicBlock *BB);
-  void replaceUsesOfWithAfter(Value *V, Value *R, BasicBlock *BB);
+  const std::vector<unsigned> &getUseBlocks(Value *V);
+  void renameUses(Value *V, ArrayRef<std::pair<BasicBlock*, PHINode*>> Defs);
+
+  // The sigma of each value in each block, and the keys that each function
+  // added, which are dropped when the pass runs on it again.
+  typedef std::pair<BasicBlock*, Value*> RedefKey;
+  DenseMap<RedefKey, PHINode*>               Redef_;
+  DenseMap<Function*, std::vector<RedefKey>> RedefKeys_;
+
+  // Sorted dominator tree DFS numbers of the blocks using each value, other
+  // than through phis, taken before the value is renamed.
+  DenseMap<Value*, std::vector<unsigned>> UseBlocks_;
+
+  // With -redef-pruned, the values whose live ranges are split.
+  SmallPtrSet<Value*, 32> Demanded_;
+
+  // With -redef-virtual, the redefinitions of a function, and the one that
+  // reaches each block reading a redefined value. A function keeps them until
+  // the pass runs on it again, so that analyses of several functions may
+  // share the pass.
+  struct VirtualForm {
+    std::vector<std::unique_ptr<PHINode>>              Nodes;
+    DenseMap<BasicBlock*, SmallVector<PHINode*, 4>>    Redefs;
+    DenseMap<std::pair<BasicBlock*, Value*>, PHINode*> Reaching;
+  };
+  std::map<Function*, VirtualForm> Virtual_;
+  VirtualForm                     *Form_;
 
-  std::map< BasicBlock*, std::map<Value*, PHINode*> > Redef_;
+  // The value and block of each virtual redefinition.
+  DenseMap<PHINode*, std::pair<Value*, BasicBlock*>> Redefined_;
 
   DominatorTree     *DT_;
   DominanceFrontier *DF_;
@@ -0,0 +1,97 @@
+//===--------------------- RedefinitionCleanup.cpp ------------------------===//
+//===----------------------------------------------------------------------===//
+
+#include "Redefinition.h"
+
+#define DEBUG_TYPE "redef-cleanup"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC(NumRemovedRedefs, "Number of redefinitions removed");
+
+// Undoes the live-range splitting of Redefinition once the ranges are no
+// longer needed: every sigma node, and every frontier phi that is left with a
+// single incoming value, is replaced by the value it redefines.
+class RedefinitionCleanup : public FunctionPass {
+public:
+  static char ID;
+  RedefinitionCleanup() : FunctionPass(ID) { }
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const;
+  virtual bool runOnFunction(Function&);
+};
+
+static RegisterPass<RedefinitionCleanup>
+  X("redef-cleanup", "Remove the redefinitions of live-range splitting");
+char RedefinitionCleanup::ID = 0;
+
+void RedefinitionCleanup::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.setPreservesCFG();
+}
+
+// Returns the single value that Phi takes other than itself, if any.
+static Value *GetRedefinedValue(PHINode *Phi) {
+  Value *Ret = nullptr;
+  for (auto &Incoming : Phi->incoming_values()) {
+    if (Incoming == Phi)
+      continue;
+    if (Ret && Incoming != Ret)
+      return nullptr;
+    Ret = Incoming;
+  }
+  return Ret;
+}
+
+bool RedefinitionCleanup::runOnFunction(Function &F) {
+  // A phi is queued at most once at a time, so that none is left in the
+  // worklist once erased.
+  std::vector<PHINode*> Worklist;
+  SmallPtrSet<PHINode*, 32> Queued;
+  auto Push = [&](PHINode *Phi) {
+    if (Redefinition::IsRedefinition(Phi) && Queued.insert(Phi).second)
+      Worklist.push_back(Phi);
+  };
+
+  for (auto &BB : F)
+    for (auto &I : BB) {
+      PHINode *Phi = dyn_cast<PHINode>(&I);
+      if (!Phi)
+        break;
+      Push(Phi);
+    }
+
+  // Removing a sigma can leave the phis using it with a single value, so
+  // those are visited again.
+  bool Changed = false;
+  while (!Worklist.empty()) {
+    PHINode *Phi = Worklist.back();
+    Worklist.pop_back();
+    Queued.erase(Phi);
+
+    Value *V = GetRedefinedValue(Phi);
+    if (!V)
+      continue;
+
+    for (auto U : Phi->users())
+      if (PHINode *User = dyn_cast<PHINode>(U))
+        if (User != Phi)
+          Push(User);
+
+    DEBUG(dbgs() << "RedefinitionCleanup: " << *Phi << " -> " << *V << "\n");
+    Phi->replaceAllUsesWith(V);
+    Phi->eraseFromParent();
+    ++NumRemovedRedefs;
+    Changed = true;
+  }
+
+  return Changed;
+}
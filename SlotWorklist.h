@@ -0,0 +1,59 @@
+#ifndef _SLOTWORKLIST_H_
+#define _SLOTWORKLIST_H_
+
+#include "llvm/ADT/BitVector.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace llvm;
+
+// Worklist over dense slot indices. Pushing (with deduplication) is O(1), and
+// pop always returns the smallest pending index, scanning the pending bits a
+// word at a time from the lowest index that may still be set.
+class SlotWorklist {
+public:
+  SlotWorklist() : Min_(0), Count_(0) { }
+
+  void resize(unsigned Size) {
+    Pending_.resize(Size);
+  }
+
+  void clear() {
+    Pending_.reset();
+    Min_ = 0;
+    Count_ = 0;
+  }
+
+  bool empty() const { return Count_ == 0; }
+  unsigned size() const { return Count_; }
+
+  bool count(unsigned Idx) const { return Pending_.test(Idx); }
+
+  // Returns false if the index was already pending.
+  bool push(unsigned Idx) {
+    if (Pending_.test(Idx))
+      return false;
+    Pending_.set(Idx);
+    Min_ = std::min(Min_, Idx);
+    ++Count_;
+    return true;
+  }
+
+  unsigned pop() {
+    assert(!empty() && "Popping from an empty worklist");
+    unsigned Idx = Pending_.test(Min_) ? Min_ : Pending_.find_next(Min_);
+    Pending_.reset(Idx);
+    Min_ = Idx + 1;
+    --Count_;
+    return Idx;
+  }
+
+private:
+  BitVector Pending_;
+  unsigned  Min_;
+  unsigned  Count_;
+};
+
+#endif
+
@@ -0,0 +1,30 @@
+#ifndef _SYMBOLICEXPR_H_
+#define _SYMBOLICEXPR_H_
+
+// Selects the symbolic expression backend used by the range analysis. SAGE is
+// the reference backend; defining SRA_NATIVE_EXPR (see configure) switches to
+// the native C++ implementation in NativeExpr.h, which does not require
+// Python or SAGE to be loaded.
+
+#ifdef SRA_NATIVE_EXPR
+
+#include "NativeExpr.h"
+
+typedef NativeContext SymContext;
+typedef NativeExpr    SymExpr;
+typedef NativeRange   SymRange;
+
+#else
+
+#include "SAGE/SAGEInterface.h"
+#include "SAGE/SAGEExpr.h"
+#include "SAGE/SAGERange.h"
+
+typedef SAGEInterface SymContext;
+typedef SAGEExpr      SymExpr;
+typedef SAGERange     SymRange;
+
+#endif
+
+#endif
+
@@ -6,9 +6,23 @@
 
 #include "SymbolicRangeAnalysis.h"
 
+#ifdef SRA_NATIVE_EXPR
+#include "SymbolicRangeCache.h"
+#endif
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
 
 raw_ostream& operator<<(raw_ostream& OS, const SymbolicRangeAnalysis& SRR) {
   SRR.print(OS, nullptr);
@@ -18,7 +32,7 @@ raw_ostream& operator<<(raw_ostream& OS, const SymbolicRangeAnalysis& SRR) {
 using namespace llvm;
 
 static RegisterPass<SymbolicRangeAnalysis>
-  X("sra", "Symbolic range analysis with SAGE and QEPCAD");
+  X("sra", "Symbolic range analysis");
 char SymbolicRangeAnalysis::ID = 0;
 
 static cl::opt<bool>
@@ -35,47 +49,184 @@ static cl::opt<int>
         cl::desc("Maximum number of (recursive) arguments to min/max"
             " expressions before they're widened to -oo/+oo"));
 
+static cl::opt<unsigned>
+    MaxRounds("sra-max-rounds", cl::init(3), cl::Hidden,
+        cl::desc("Maximum number of rounds over a cyclic component before"
+            " its still-changing bounds are widened"));
+
+static cl::opt<bool>
+    UseThresholds("sra-widening-thresholds", cl::init(true), cl::Hidden,
+        cl::desc("Widen still-changing bounds to the bounds of the loop's"
+            " comparisons, when known to hold, before -oo/+oo"));
+
+static cl::opt<unsigned>
+    NarrowingRounds("sra-narrowing-rounds", cl::init(2), cl::Hidden,
+        cl::desc("Maximum number of rounds over a widened cyclic component"
+            " that tighten its bounds"));
+
+static cl::opt<bool>
+    UseInductionVars("sra-induction-vars", cl::init(true), cl::Hidden,
+        cl::desc("Give affine induction variables closed-form ranges computed"
+            " from their trip counts, instead of iterating"));
+
+static cl::opt<bool>
+    Lazy("sra-lazy", cl::init(false), cl::Hidden,
+        cl::desc("Solve ranges on demand, only for the values each query"
+            " depends on"));
+
 static cl::opt<bool>
     UseNumericBounds("sra-use-numeric-bounds", cl::init(false), cl::Hidden,
         cl::desc("Use numbers as bounds, instead of -/+oo"));
 
+static cl::opt<std::string>
+    CacheDir("sra-cache-dir", cl::init(""), cl::Hidden,
+        cl::desc("Directory in which converged ranges are cached across runs"
+            " (native backend only)"));
+
 const unsigned CHANGED_LOWER = 1 << 0;
 const unsigned CHANGED_UPPER = 1 << 1;
 
-static SAGERange GetBoundsForTy(Type *Ty, SAGEInterface *SI) {
-  static SAGERange InfRange =
-      SAGERange(SAGEExpr::getMinusInf(*SI), SAGEExpr::getPlusInf(*SI));
+SymbolicRangeContext::SymbolicRangeContext(SymContext &Ctx)
+    : Ctx(Ctx), BottomExpr(Ctx, "_BOT_"), Bottom(BottomExpr),
+      InfRange(SymExpr::getMinusInf(Ctx), SymExpr::getPlusInf(Ctx)),
+      NextTemp(1) {
+}
+
+static SymRange GetBoundsForTy(Type *Ty, const SymbolicRangeContext &RC) {
   if (!UseNumericBounds) {
-    return InfRange;
+    return RC.InfRange;
   }
 
+  SymContext *Ctx = &RC.Ctx;
   unsigned Width = Ty->getIntegerBitWidth();
   if (ShouldUseSymBounds) {
     switch (Width) {
       case 8:
-        return SAGERange(SAGEExpr(*SI, "CHAR_MIN"), SAGEExpr(*SI, "UCHAR_MAX"));
+        return SymRange(SymExpr(*Ctx, "CHAR_MIN"),
+                        SymExpr(*Ctx, "UCHAR_MAX"));
       case 16:
-        return SAGERange(SAGEExpr(*SI, "SHRT_MIN"), SAGEExpr(*SI, "USHRT_MAX"));
+        return SymRange(SymExpr(*Ctx, "SHRT_MIN"),
+                        SymExpr(*Ctx, "USHRT_MAX"));
       case 32:
-        return SAGERange(SAGEExpr(*SI, "INT_MIN"), SAGEExpr(*SI, "UINT_MAX"));
+        return SymRange(SymExpr(*Ctx, "INT_MIN"), SymExpr(*Ctx, "UINT_MAX"));
       case 64:
-        return SAGERange(SAGEExpr(*SI, "LONG_MIN"), SAGEExpr(*SI, "ULONG_MAX"));
+        return SymRange(SymExpr(*Ctx, "LONG_MIN"),
+                        SymExpr(*Ctx, "ULONG_MAX"));
     }
   }
   uint64_t Upper = APInt::getMaxValue(Width).getZExtValue();
   int64_t Lower = APInt::getSignedMinValue(Width).getSExtValue();
-  return SAGERange(SAGEExpr(*SI, Lower), SAGEExpr(*SI, Upper));
+  return SymRange(SymExpr(*Ctx, Lower), SymExpr(*Ctx, Upper));
+}
+
+static SymRange GetBoundsForValue(Value *V, const SymbolicRangeContext &RC) {
+  return GetBoundsForTy(V->getType(), RC);
+}
+
+static bool IsKnownNonNegative(const SymExpr &E, SymbolicRangeAnalysis *SRA) {
+  return E.isGE(SymExpr(SRA->getContext(), (int64_t) 0));
+}
+
+// Scales a bound by a positive constant, leaving infinities alone.
+static SymExpr ScaleBound(const SymExpr &E, int64_t Factor) {
+  return E.isMinusInf() || E.isPlusInf() ? E : E * Factor;
+}
+
+static SymExpr DivideBound(const SymExpr &E, int64_t Divisor) {
+  return E.isMinusInf() || E.isPlusInf() ? E : E / Divisor;
+}
+
+// Shifts by a constant amount, which become multiplications and divisions by
+// a power of two.
+static SymRange Shift(BinaryOperator *BO, const SymRange &LHS,
+                      SymbolicRangeAnalysis *SRA) {
+  auto Ret = GetBoundsForValue(BO, SRA->getRangeContext());
+  unsigned Width = BO->getType()->getIntegerBitWidth();
+  ConstantInt *CI = dyn_cast<ConstantInt>(BO->getOperand(1));
+  if (!CI || CI->getValue().uge(std::min(Width, 63u)))
+    return Ret;
+
+  unsigned Amount = CI->getZExtValue();
+  int64_t Factor = (int64_t) 1 << Amount;
+  switch (BO->getOpcode()) {
+    case Instruction::Shl:
+      Ret = SymRange(ScaleBound(LHS.getLower(), Factor),
+                     ScaleBound(LHS.getUpper(), Factor));
+      break;
+    case Instruction::LShr:
+      // Only non-negative values shift as they divide.
+      if (IsKnownNonNegative(LHS.getLower(), SRA))
+        Ret = SymRange(DivideBound(LHS.getLower(), Factor),
+                       DivideBound(LHS.getUpper(), Factor));
+      else if (Amount > 0)
+        Ret = SymRange(
+            SymExpr(SRA->getContext(), (int64_t) 0),
+            SymExpr(SRA->getContext(),
+                    (int64_t) APInt::getMaxValue(Width).lshr(Amount)
+                                  .getZExtValue()));
+      break;
+    case Instruction::AShr:
+      // Shifts round down, while divisions round towards zero, so negative
+      // lower bounds are moved down first.
+      Ret = SymRange(
+          IsKnownNonNegative(LHS.getLower(), SRA)
+              ? DivideBound(LHS.getLower(), Factor)
+              : DivideBound(LHS.getLower() - (Factor - 1), Factor),
+          DivideBound(LHS.getUpper(), Factor));
+      break;
+    default:
+      break;
+  }
+  return Ret;
 }
 
-static SAGERange GetBoundsForValue(Value *V, SAGEInterface *SI) {
-  return GetBoundsForTy(V->getType(), SI);
+// Masking with a non-negative value yields a value between zero and it.
+static SymRange And(BinaryOperator *BO, const SymRange &LHS,
+                    const SymRange &RHS, SymbolicRangeAnalysis *SRA) {
+  auto Ret = GetBoundsForValue(BO, SRA->getRangeContext());
+  bool LHSNonNeg = IsKnownNonNegative(LHS.getLower(), SRA),
+       RHSNonNeg = IsKnownNonNegative(RHS.getLower(), SRA);
+  if (!LHSNonNeg && !RHSNonNeg)
+    return Ret;
+
+  SymExpr Upper = LHSNonNeg && RHSNonNeg
+      ? LHS.getUpper().min(RHS.getUpper())
+      : (LHSNonNeg ? LHS.getUpper() : RHS.getUpper());
+  return SymRange(SymExpr(SRA->getContext(), (int64_t) 0), Upper);
+}
+
+// Remainders by a positive divisor are smaller than it in magnitude, and no
+// larger than the dividend, whose sign they take.
+static SymRange Rem(BinaryOperator *BO, const SymRange &LHS,
+                    const SymRange &RHS, SymbolicRangeAnalysis *SRA) {
+  auto Ret = GetBoundsForValue(BO, SRA->getRangeContext());
+  SymExpr Zero(SRA->getContext(), (int64_t) 0);
+  bool IsUnsigned = BO->getOpcode() == Instruction::URem;
+  // Ranges are signed, and an unsigned remainder by a divisor that may be
+  // negative, i.e. huge, can be any value the dividend can.
+  if (!RHS.getLower().isGE(Zero + 1) || RHS.getUpper().isPlusInf())
+    return Ret;
+
+  SymExpr Upper = RHS.getUpper() - 1;
+  if (IsKnownNonNegative(LHS.getLower(), SRA)) {
+    if (!LHS.getUpper().isPlusInf())
+      Upper = Upper.min(LHS.getUpper());
+    return SymRange(Zero, Upper);
+  }
+  if (IsUnsigned)
+    return SymRange(Zero, Upper);
+
+  SymExpr Lower = Zero - Upper;
+  if (!LHS.getLower().isMinusInf())
+    Lower = Lower.max(LHS.getLower());
+  return SymRange(Lower, Upper);
 }
 
-static SAGERange BinaryOp(BinaryOperator *BO, SymbolicRangeAnalysis *SRA) {
+static SymRange BinaryOp(BinaryOperator *BO, SymbolicRangeAnalysis *SRA) {
   DEBUG(dbgs() << "SRA: BinaryOp: " << *BO << "\n");
 
-  auto LHS = SRA->getStateOrInf(BO->getOperand(0)),
-       RHS = SRA->getStateOrInf(BO->getOperand(1));
+  auto LHS = SRA->getStateOrInf(SRA->getDef(BO->getOperandUse(0))),
+       RHS = SRA->getStateOrInf(SRA->getDef(BO->getOperandUse(1)));
 
   switch (BO->getOpcode()) {
     case Instruction::Add: {
@@ -97,7 +248,7 @@ static SAGERange BinaryOp(BinaryOperator *BO, SymbolicRangeAnalysis *SRA) {
           || RHS.getLower().isMinusInf() || LHS.getUpper().isPlusInf()
           || RHS.getUpper().isPlusInf();
       if (boundsShouldBeInf) {
-        auto Ret = GetBoundsForValue(BO, &SRA->getSI());
+        auto Ret = GetBoundsForValue(BO, SRA->getRangeContext());
         DEBUG(dbgs() << "     BinaryOp: return " << Ret << "\n");
         return Ret;
       }
@@ -114,7 +265,7 @@ static SAGERange BinaryOp(BinaryOperator *BO, SymbolicRangeAnalysis *SRA) {
           || RHS.getLower().isMinusInf() || LHS.getUpper().isPlusInf()
           || RHS.getUpper().isPlusInf();
       if (boundsShouldBeInf) {
-        auto Ret = GetBoundsForValue(BO, &SRA->getSI());
+        auto Ret = GetBoundsForValue(BO, SRA->getRangeContext());
         DEBUG(dbgs() << "     BinaryOp: return " << Ret << "\n");
         return Ret;
       }
@@ -123,19 +274,43 @@ static SAGERange BinaryOp(BinaryOperator *BO, SymbolicRangeAnalysis *SRA) {
       DEBUG(dbgs() << "     BinaryOp: return " << Ret << "\n");
       return Ret;
     }
+    case Instruction::Shl:
+    case Instruction::LShr:
+    case Instruction::AShr: {
+      DEBUG(dbgs() << "     BinaryOp: " << LHS << " shifted by " << RHS
+                   << "\n");
+      auto Ret = Shift(BO, LHS, SRA);
+      DEBUG(dbgs() << "     BinaryOp: return " << Ret << "\n");
+      return Ret;
+    }
+    case Instruction::And: {
+      DEBUG(dbgs() << "     BinaryOp: " << LHS << " & " << RHS << "\n");
+      auto Ret = And(BO, LHS, RHS, SRA);
+      DEBUG(dbgs() << "     BinaryOp: return " << Ret << "\n");
+      return Ret;
+    }
+    case Instruction::URem:
+    case Instruction::SRem: {
+      DEBUG(dbgs() << "     BinaryOp: " << LHS << " % " << RHS << "\n");
+      auto Ret = Rem(BO, LHS, RHS, SRA);
+      DEBUG(dbgs() << "     BinaryOp: return " << Ret << "\n");
+      return Ret;
+    }
     default: {
-      auto Ret = GetBoundsForValue(BO, &SRA->getSI());
+      auto Ret = GetBoundsForValue(BO, SRA->getRangeContext());
       DEBUG(dbgs() << "     BinaryOp: return " << Ret << "\n");
       return Ret;
     }
   }
 }
 
-static SAGERange Narrow(PHINode *Phi, Value *V, ICmpInst::Predicate Pred,
+static SymRange Narrow(PHINode *Phi, Value *V, ICmpInst::Predicate Pred,
                         SymbolicRangeAnalysis *SRA) {
   DEBUG(dbgs() << "SRA: Narrow: " << *Phi << ", " << *V << "\n");
 
-  auto Ret   = SRA->getStateOrInf(Phi->getIncomingValue(0)),
+  SmallVector<Value*, 1> Defs;
+  SRA->getIncomingDefs(Phi, Defs);
+  auto Ret   = SRA->getStateOrInf(Defs[0]),
        Bound = SRA->getStateOrInf(V);
 
   switch (Pred) {
@@ -182,12 +357,14 @@ static SAGERange Narrow(PHINode *Phi, Value *V, ICmpInst::Predicate Pred,
   return Ret;
 }
 
-static SAGERange Meet(PHINode *Phi, SymbolicRangeAnalysis *SRA) {
+static SymRange Meet(PHINode *Phi, SymbolicRangeAnalysis *SRA) {
   DEBUG(dbgs() << "SRA: Meet: " << *Phi << "\n");
 
-  if (MaxPhiEvalSize > 0 && Phi->getNumOperands() > (unsigned) MaxPhiEvalSize) {
-    SAGERange Ret =
-        GetBoundsForTy(cast<IntegerType>(Phi->getType()), &SRA->getSI());
+  SmallVector<Value*, 8> Defs;
+  SRA->getIncomingDefs(Phi, Defs);
+  if (MaxPhiEvalSize > 0 && Defs.size() > (unsigned) MaxPhiEvalSize) {
+    SymRange Ret = GetBoundsForTy(cast<IntegerType>(Phi->getType()),
+                                  SRA->getRangeContext());
     Ret.setLower(Ret.getLower());
     Ret.setUpper(Ret.getUpper());
     DEBUG(dbgs() << "     Meet: pruning evaluation\n");
@@ -195,15 +372,15 @@ static SAGERange Meet(PHINode *Phi, SymbolicRangeAnalysis *SRA) {
     return Ret;
   }
 
-  SAGERange Ret = SRA->getState(Phi->getIncomingValue(0));
-  auto OI = Phi->op_begin(), OE = Phi->op_end();
+  SymRange Ret = SRA->getState(Defs[0]);
+  auto OI = Defs.begin(), OE = Defs.end();
   for (; Ret == SRA->getBottom() && OI != OE; ++OI)
     Ret = SRA->getState(*OI);
 
   DEBUG(dbgs() << "     Meet: starting with " << Ret << "\n");
 
   for (; OI != OE; ++OI) {
-    SAGERange Incoming = SRA->getState(*OI);
+    SymRange Incoming = SRA->getState(*OI);
     if (Incoming == SRA->getBottom())
       continue;
     Ret.setLower(Ret.getLower().min(Incoming.getLower()));
@@ -215,69 +392,216 @@ static SAGERange Meet(PHINode *Phi, SymbolicRangeAnalysis *SRA) {
   return Ret;
 }
 
+// A select of the smaller (or larger) of the two values it compares is their
+// min (or max). Any other select takes either value.
+static SymRange Select(SelectInst *SI, SymbolicRangeAnalysis *SRA) {
+  DEBUG(dbgs() << "SRA: Select: " << *SI << "\n");
+
+  Value *TV = SI->getTrueValue(), *FV = SI->getFalseValue();
+  auto T = SRA->getState(SRA->getDef(SI->getOperandUse(1))),
+       F = SRA->getState(SRA->getDef(SI->getOperandUse(2)));
+  if (T == SRA->getBottom() || F == SRA->getBottom()) {
+    auto Ret = T == SRA->getBottom() ? F : T;
+    DEBUG(dbgs() << "     Select: return " << Ret << "\n");
+    return Ret;
+  }
+
+  // Normalize the comparison to (TV Pred FV).
+  CmpInst::Predicate Pred = CmpInst::BAD_ICMP_PREDICATE;
+  if (ICmpInst *ICI = dyn_cast<ICmpInst>(SI->getCondition())) {
+    if (ICI->getOperand(0) == TV && ICI->getOperand(1) == FV)
+      Pred = ICI->getPredicate();
+    else if (ICI->getOperand(0) == FV && ICI->getOperand(1) == TV)
+      Pred = ICI->getSwappedPredicate();
+  }
+
+  // Unsigned comparisons only order non-negative values the same way.
+  if (CmpInst::isUnsigned(Pred) &&
+      !(IsKnownNonNegative(T.getLower(), SRA) &&
+        IsKnownNonNegative(F.getLower(), SRA)))
+    Pred = CmpInst::BAD_ICMP_PREDICATE;
+
+  SymRange Ret = T;
+  switch (Pred) {
+    case CmpInst::ICMP_SLT:
+    case CmpInst::ICMP_SLE:
+    case CmpInst::ICMP_ULT:
+    case CmpInst::ICMP_ULE:
+      DEBUG(dbgs() << "     Select: min(" << T << ", " << F << ")\n");
+      Ret = SymRange(T.getLower().min(F.getLower()),
+                     T.getUpper().min(F.getUpper()));
+      break;
+    case CmpInst::ICMP_SGT:
+    case CmpInst::ICMP_SGE:
+    case CmpInst::ICMP_UGT:
+    case CmpInst::ICMP_UGE:
+      DEBUG(dbgs() << "     Select: max(" << T << ", " << F << ")\n");
+      Ret = SymRange(T.getLower().max(F.getLower()),
+                     T.getUpper().max(F.getUpper()));
+      break;
+    default:
+      Ret = SymRange(T.getLower().min(F.getLower()),
+                     T.getUpper().max(F.getUpper()));
+      break;
+  }
+
+  DEBUG(dbgs() << "     Select: return " << Ret << "\n");
+  return Ret;
+}
+
 void SymbolicRangeAnalysis::getAnalysisUsage(AnalysisUsage &AU) const {
+#ifndef SRA_NATIVE_EXPR
   AU.addRequired<SAGEInterface>();
+#endif
   AU.addRequired<Redefinition>();
+  AU.addRequired<ScalarEvolution>();
   AU.setPreservesAll();
 }
 
 bool SymbolicRangeAnalysis::runOnFunction(Function& F) {
+#ifdef SRA_NATIVE_EXPR
+  SymContext *Ctx = nullptr;
+#else
+  SymContext *Ctx = &getAnalysis<SAGEInterface>();
+#endif
+
+  prepare(F, &getAnalysis<Redefinition>(), Ctx,
+          &getAnalysis<ScalarEvolution>());
+  if (!Lazy)
+    solve();
+
+  DEBUG(dbgs() << *this << "\n");
+
+  return false;
+}
+
+void SymbolicRangeAnalysis::prepare(Function &F, Redefinition *RDF,
+                                    SymContext *Ctx, ScalarEvolution *SE) {
   Module_ = F.getParent();
-  SI_ = &getAnalysis<SAGEInterface>();
+  Function_ = &F;
+  RDF_ = RDF;
+  SE_ = SE;
+
+  // Expressions from the previous function are no longer referenced once
+  // initialize clears the slot table.
+#ifdef SRA_NATIVE_EXPR
+  if (!Ctx) {
+    NativeCtx_.reset(new NativeContext());
+    Ctx = NativeCtx_.get();
+  }
+#endif
+  Ctx_ = Ctx;
+  RangeCtx_.reset(new SymbolicRangeContext(*Ctx));
 
   dbgs() << "SRA: runOnModule: " << F.getName() << "\n";
 
-  RDF_ = &getAnalysis<Redefinition>();
-
   initialize(&F);
-  reset(&F);
-  iterate(&F);
-  reset(&F);
-  iterate(&F);
-  reset(&F);
-  iterate(&F);
-  widen(&F);
 
-  DEBUG(dbgs() << *this << "\n");
+#ifdef SRA_NATIVE_EXPR
+  // With summaries, the ranges also depend on the callees, which are only
+  // solved later, so they are not cached.
+  CacheKey_.clear();
+  if (!CacheDir.empty() && !Callees_)
+    loadCached(F);
+#endif
+}
 
-  return false;
+#ifdef SRA_NATIVE_EXPR
+// Options that change the ranges computed for a given function.
+static std::string GetCacheOptions() {
+  std::string Options;
+  raw_string_ostream OS(Options);
+  OS << "sym-bounds=" << ShouldUseSymBounds
+     << ";max-phi-eval-size=" << MaxPhiEvalSize
+     << ";max-expr-size=" << MaxExprSize
+     << ";max-rounds=" << MaxRounds
+     << ";widening-thresholds=" << UseThresholds
+     << ";narrowing-rounds=" << NarrowingRounds
+     << ";numeric-bounds=" << UseNumericBounds
+     << ";induction-vars=" << UseInductionVars;
+  return OS.str();
+}
+
+// On a hit, every slot takes its cached state and is marked as solved.
+// Otherwise the key is kept, and solve stores the states once it converges.
+bool SymbolicRangeAnalysis::loadCached(Function &F) {
+  CacheKey_ = SymbolicRangeCache::getKey(F, GetCacheOptions());
+
+  std::vector<SymRange> Ranges;
+  if (!SymbolicRangeCache(CacheDir).load(CacheKey_, *Ctx_, Ranges) ||
+      Ranges.size() != Slots_.size())
+    return false;
+
+  for (unsigned Idx = 0; Idx < Slots_.size(); ++Idx)
+    Slots_[Idx].State = Ranges[Idx];
+  SolvedSCCs_.set();
+  CacheKey_.clear();
+  return true;
 }
 
-SAGEExpr SymbolicRangeAnalysis::getBottomExpr() const {
-  static SAGEExpr BottomExpr(*SI_, "_BOT_");
-  return BottomExpr;
+void SymbolicRangeAnalysis::storeCached() {
+  std::vector<SymRange> Ranges;
+  for (auto &S : Slots_)
+    Ranges.push_back(S.State);
+  SymbolicRangeCache(CacheDir).store(CacheKey_, Ranges);
+  CacheKey_.clear();
 }
+#endif
 
-SAGERange SymbolicRangeAnalysis::getBottom() const {
-  static SAGERange BottomRange(getBottomExpr());
-  return BottomRange;
+bool SymbolicRangeAnalysis::isDemandDriven() const {
+  return Lazy;
+}
+
+SymExpr SymbolicRangeAnalysis::getBottomExpr() const {
+  return RangeCtx_->BottomExpr;
+}
+
+SymRange SymbolicRangeAnalysis::getBottom() const {
+  return RangeCtx_->Bottom;
 }
 
 std::string SymbolicRangeAnalysis::makeName(Function *F, Value *V) {
-  static unsigned Temp = 1;
   if (V->hasName()) {
     auto Name = (F->getName() + Twine("_") + V->getName()).str();
     std::replace(Name.begin(), Name.end(), '.', '_');
     return Name;
   } else
-    return (F->getName() + Twine("_") + Twine(Temp++)).str();
+    return (F->getName() + Twine("_") + Twine(RangeCtx_->NextTemp++)).str();
 }
 
 void SymbolicRangeAnalysis::setName(Value *V, std::string Name) {
-  Name_[V] = Name;
+  Slots_[getIndex(V)].Name = Name;
   Value_[Name] = V;
 }
 
 std::string SymbolicRangeAnalysis::getName(Value *V) const {
-  auto It = Name_.find(V);
-  assert(It != Name_.end() && "Requested value is not in map");
+  return Slots_[getIndex(V)].Name;
+}
+
+unsigned SymbolicRangeAnalysis::addSlot(Value *V, std::string Name,
+                                        SymRange State) {
+  unsigned Idx = Slots_.size();
+  Slots_.push_back(Slot(V, Name, State, 0));
+  Index_[V] = Idx;
+  Value_[Name] = V;
+  return Idx;
+}
+
+unsigned SymbolicRangeAnalysis::getIndex(Value *V) const {
+  auto It = Index_.find(V);
+  assert(It != Index_.end() && "Requested value is not in map");
   return It->second;
 }
 
-void SymbolicRangeAnalysis::setState(Value *V, SAGERange Range) {
-  DEBUG(dbgs() << "SRA: setState(" << *V << "," << Range << ")\n");
+void SymbolicRangeAnalysis::setState(Value *V, SymRange Range) {
+  setState(getIndex(V), Range);
+}
+
+void SymbolicRangeAnalysis::setState(unsigned Idx, SymRange Range) {
+  Slot &S = Slots_[Idx];
+  DEBUG(dbgs() << "SRA: setState(" << *S.V << "," << Range << ")\n");
 
-  auto Bounds = GetBoundsForValue(V, SI_);
+  auto Bounds = GetBoundsForValue(S.V, *RangeCtx_);
   if (Range.getLower().getSize() > MaxExprSize) {
     Range.setLower(Bounds.getLower());
   }
@@ -286,79 +610,426 @@ void SymbolicRangeAnalysis::setState(Value *V, SAGERange Range) {
     Range.setUpper(Bounds.getUpper());
   }
 
-  auto It = State_.insert(std::make_pair(V, Range));
-  if (!It.second) {
-    if (It.first->second != Range)
-      setChanged(V, It.first->second, Range);
-    It.first->second = Range;
-  } else if (isa<Instruction>(V)) {
-    Changed_[V] = CHANGED_LOWER | CHANGED_UPPER;
-  }
+  if (S.State != Range)
+    setChanged(Idx, S.State, Range);
+  S.State = Range;
 }
 
-void SymbolicRangeAnalysis::setChanged(Value *V, SAGERange &Prev,
-                                       SAGERange &New) {
+void SymbolicRangeAnalysis::setChanged(unsigned Idx, const SymRange &Prev,
+                                       const SymRange &New) {
+  Slot &S = Slots_[Idx];
   unsigned Changed = (Prev.getLower().isNE(New.getLower()) ? CHANGED_LOWER : 0)
       | (Prev.getUpper().isNE(New.getUpper()) ? CHANGED_UPPER : 0);
-  Changed_[V] = Changed;
+  S.Changed = Changed;
 
-  auto It = StableBounds_.find(V);
-  if (It == StableBounds_.end()) {
-    StableBounds_[V] = std::make_pair(true, true);
+  if (!S.HasStableBounds) {
+    S.HasStableBounds = S.StableLower = S.StableUpper = true;
     return;
   }
 
-  bool StableLower = !(Changed & CHANGED_LOWER),
-      StableUpper = !(Changed & CHANGED_UPPER);
-  It->second = std::make_pair(
-      It->second.first & StableLower, It->second.second & StableUpper);
+  S.StableLower &= !(Changed & CHANGED_LOWER);
+  S.StableUpper &= !(Changed & CHANGED_UPPER);
 }
 
 bool SymbolicRangeAnalysis::hasStableLowerBound(Value *V) const {
-  auto It = StableBounds_.find(V);
-  return It == StableBounds_.end() ? false : It->second.first;
+  auto It = Index_.find(V);
+  return It == Index_.end() ? false : Slots_[It->second].StableLower;
 }
 
 bool SymbolicRangeAnalysis::hasStableUpperBound(Value *V) const {
-  auto It = StableBounds_.find(V);
-  return It == StableBounds_.end() ? false : It->second.second;
+  auto It = Index_.find(V);
+  return It == Index_.end() ? false : Slots_[It->second].StableUpper;
 }
 
-SAGERange SymbolicRangeAnalysis::getState(Value *V) const {
+SymRange SymbolicRangeAnalysis::getState(Value *V) const {
   // TODO: Handle ptrtoint.
   if (ConstantInt *CI = dyn_cast<ConstantInt>(V))
-    return SAGEExpr(*SI_, CI->getValue().getSExtValue());
+    return SymExpr(*Ctx_, CI->getValue().getSExtValue());
   if (isa<UndefValue>(V) || isa<Constant>(V))
-    return GetBoundsForValue(V, SI_);
-  auto It = State_.find(V);
-  assert(It != State_.end() && "Requested value is not in map");
-  return It->second;
+    return GetBoundsForValue(V, *RangeCtx_);
+  if (!Dirty_.empty())
+    const_cast<SymbolicRangeAnalysis*>(this)->update();
+  unsigned Idx = getIndex(V);
+  if (!SolvedSCCs_.test(SCCOf_[Idx]))
+    const_cast<SymbolicRangeAnalysis*>(this)->demand(Idx);
+  return Slots_[Idx].State;
 }
 
-SAGERange SymbolicRangeAnalysis::getStateOrInf(Value *V) const {
+SymRange SymbolicRangeAnalysis::getStateOrInf(Value *V) const {
   auto State = getState(V);
   return State != getBottom()
-      ? State : GetBoundsForTy(cast<IntegerType>(V->getType()), SI_);
+      ? State : GetBoundsForTy(cast<IntegerType>(V->getType()), *RangeCtx_);
+}
+
+// A phi reads its incoming values at the end of the incoming blocks.
+Value *SymbolicRangeAnalysis::getDef(const Use &U) const {
+  if (!RDF_->isVirtual())
+    return U.get();
+  Instruction *I = cast<Instruction>(U.getUser());
+  if (PHINode *Phi = dyn_cast<PHINode>(I))
+    return RDF_->getDefAt(U.get(), Phi->getIncomingBlock(U));
+  return RDF_->getDefAt(U.get(), I->getParent());
+}
+
+void SymbolicRangeAnalysis::getIncomingDefs(
+    PHINode *Phi, SmallVectorImpl<Value*> &Defs) const {
+  RDF_->getIncomingDefs(Phi, Defs);
+}
+
+bool SymbolicRangeAnalysis::mayWrap(Value *V) const {
+  if (isa<Constant>(V))
+    return false;
+  if (!Dirty_.empty())
+    const_cast<SymbolicRangeAnalysis*>(this)->update();
+  if (MayWrap_.size() != Slots_.size())
+    const_cast<SymbolicRangeAnalysis*>(this)->computeMayWrap();
+  auto It = Index_.find(V);
+  return It != Index_.end() && MayWrap_.test(It->second);
+}
+
+// Returns true if the transfer function of slot Idx may not hold even when
+// those of its operands do.
+bool SymbolicRangeAnalysis::wrapsLocally(unsigned Idx) {
+  const Slot &S = Slots_[Idx];
+  switch (S.Kind) {
+    case TK_BinaryOp: {
+      BinaryOperator *BO = cast<BinaryOperator>(S.V);
+      switch (BO->getOpcode()) {
+        case Instruction::Add:
+        case Instruction::Sub:
+        case Instruction::Mul:
+        case Instruction::Shl:
+          return !BO->hasNoSignedWrap();
+        case Instruction::UDiv:
+          // Read as a signed division.
+          return true;
+        default:
+          return false;
+      }
+    }
+    case TK_Cast: {
+      CastInst *CI = cast<CastInst>(S.V);
+      if (CI->getOpcode() == Instruction::SExt)
+        return false;
+      SymRange Range = getStateOrInf(getDef(CI->getOperandUse(0)));
+      if (CI->getOpcode() == Instruction::ZExt)
+        return !IsKnownNonNegative(Range.getLower(), this);
+      unsigned Width = CI->getType()->getIntegerBitWidth();
+      return !Range.getLower().isGE(SymExpr(*Ctx_,
+                 APInt::getSignedMinValue(Width).getSExtValue())) ||
+             !Range.getUpper().isLE(SymExpr(*Ctx_,
+                 APInt::getSignedMaxValue(Width).getSExtValue()));
+    }
+    case TK_Narrow: {
+      // Below a non-negative bound, in unsigned terms, values are below it in
+      // signed terms too; above a bound, only non-negative values are.
+      SmallVector<Value*, 1> Defs;
+      getIncomingDefs(cast<PHINode>(S.V), Defs);
+      switch (S.Pred) {
+        case CmpInst::ICMP_ULT:
+        case CmpInst::ICMP_ULE:
+          return !IsKnownNonNegative(getStateOrInf(S.Bound).getLower(), this);
+        case CmpInst::ICMP_UGT:
+        case CmpInst::ICMP_UGE:
+          return !IsKnownNonNegative(getStateOrInf(Defs[0]).getLower(), this);
+        default:
+          return false;
+      }
+    }
+#ifdef SRA_NATIVE_EXPR
+    case TK_Call: {
+      // A summary holds only if the values the callee returns do.
+      CallInst *CI = cast<CallInst>(S.V);
+      auto It = Callees_->find(CI->getCalledFunction());
+      if (It == Callees_->end())
+        return false;
+      if (It->second == this)
+        return true;
+      for (auto &BB : *CI->getCalledFunction())
+        if (ReturnInst *RI = dyn_cast<ReturnInst>(BB.getTerminator()))
+          if (RI->getReturnValue() &&
+              It->second->mayWrap(It->second->getDef(RI->getOperandUse(0))))
+            return true;
+      return false;
+    }
+#endif
+    default:
+      return false;
+  }
+}
+
+// A slot may wrap if its own transfer function may, or if any of the values
+// it reads may.
+void SymbolicRangeAnalysis::computeMayWrap() {
+  MayWrap_.clear();
+  MayWrap_.resize(Slots_.size());
+
+  std::vector<unsigned> Worklist;
+  for (unsigned Idx = 0, E = Slots_.size(); Idx != E; ++Idx)
+    if (Slots_[Idx].V && wrapsLocally(Idx)) {
+      MayWrap_.set(Idx);
+      Worklist.push_back(Idx);
+    }
+
+  while (!Worklist.empty()) {
+    unsigned Idx = Worklist.back();
+    Worklist.pop_back();
+    for (unsigned User : getUsers(Idx))
+      if (!MayWrap_.test(User)) {
+        MayWrap_.set(User);
+        Worklist.push_back(User);
+      }
+  }
 }
 
 std::pair<Value*, Value*>
-    SymbolicRangeAnalysis::getRangeValuesFor(Value *V, IRBuilder<> IRB) const {
-  SAGERange Range = getStateOrInf(V);
-  IntegerType *Ty = cast<IntegerType>(V->getType());
+    SymbolicRangeAnalysis::getRangeValuesFor(Value *V, IRBuilder<> IRB,
+                                             DominatorTree *DT,
+                                             IntegerType *EmitTy) const {
+  SymRange Range = getStateOrInf(V);
+  IntegerType *Ty = EmitTy ? EmitTy : cast<IntegerType>(V->getType());
+#ifdef SRA_NATIVE_EXPR
+  BasicBlock *BB = IRB.GetInsertBlock();
+  BasicBlock::iterator Pt = IRB.GetInsertPoint();
+  Value *At = Pt == BB->end() ? (Value*) BB : (Value*) &(*Pt);
+  if (MaterializedAt_ != At) {
+    MaterializedAt_ = At;
+    Materialized_.clear();
+  }
+  if (SeedsSolved_ != SolvedSCCs_.count())
+    indexSeeds();
+  SmallPtrSet<const NativeNode*, 16> Visited;
+  seedMaterialized(Range.getLower().getNode(), Ty, BB, Pt, DT, Visited);
+  seedMaterialized(Range.getUpper().getNode(), Ty, BB, Pt, DT, Visited);
+  Value *Lower = Range.getLower().toValue(Ty, IRB, Value_, Materialized_),
+        *Upper = Range.getUpper().toValue(Ty, IRB, Value_, Materialized_);
+#else
   Value *Lower = Range.getLower().toValue(Ty, IRB, Value_, Module_),
         *Upper = Range.getUpper().toValue(Ty, IRB, Value_, Module_);
+#endif
   return std::make_pair(Lower, Upper);
 }
 
-void SymbolicRangeAnalysis::createNarrowingFn(Value *LHS, Value *RHS,
+#ifdef SRA_NATIVE_EXPR
+// Constants, including the constant terms of sums, must fit in Ty, and
+// symbols must name values rather than type limits.
+static bool IsMaterializable(const NativeNode *N, IntegerType *Ty,
+                             const std::map<std::string, Value*> &Values) {
+  unsigned Width = Ty->getBitWidth();
+  switch (N->getKind()) {
+    case NativeNode::NK_Int:
+    case NativeNode::NK_Add:
+      if (Width < 64 &&
+          (N->getInt() < APInt::getSignedMinValue(Width).getSExtValue() ||
+           N->getInt() > APInt::getSignedMaxValue(Width).getSExtValue()))
+        return false;
+      break;
+    case NativeNode::NK_Sym:
+      return Values.count(N->getName().str());
+    case NativeNode::NK_MinusInf:
+    case NativeNode::NK_PlusInf:
+    case NativeNode::NK_Undef:
+      return false;
+    default:
+      break;
+  }
+  for (auto Op : N->getOps())
+    if (!IsMaterializable(Op, Ty, Values))
+      return false;
+  return true;
+}
+
+// Returns M such that |C| <= 2^M.
+static unsigned GetMagnitude(int64_t C) {
+  uint64_t Abs = C < 0 ? -(uint64_t) C : C;
+  return Abs <= 1 ? 0 : Log2_64_Ceil(Abs);
+}
+
+// Finds M such that |N| <= 2^M whatever the values of its symbols, which are
+// sign extended to Width bits. Returns false if N, or one of the sums,
+// products and quotients it is emitted with, may not fit in Width bits.
+// Divisors must be non-zero constants, so that the emitted division cannot
+// trap where the program would not have divided.
+static bool GetMagnitude(const NativeNode *N, unsigned Width,
+                         const std::map<std::string, Value*> &Values,
+                         unsigned &M) {
+  switch (N->getKind()) {
+    case NativeNode::NK_Int:
+      M = GetMagnitude(N->getInt());
+      return M < Width;
+    case NativeNode::NK_Sym: {
+      auto It = Values.find(N->getName().str());
+      if (It == Values.end())
+        return false;
+      unsigned SymWidth = It->second->getType()->getIntegerBitWidth();
+      M = SymWidth - 1;
+      return SymWidth <= Width;
+    }
+    case NativeNode::NK_Add: {
+      auto Ops = N->getOps();
+      auto Coeffs = N->getCoeffs();
+      unsigned Max = GetMagnitude(N->getInt()), OpM;
+      for (unsigned Idx = 0; Idx < Ops.size(); ++Idx) {
+        if (!GetMagnitude(Ops[Idx], Width, Values, OpM))
+          return false;
+        Max = std::max(Max, OpM + GetMagnitude(Coeffs[Idx]));
+      }
+      M = Max + Log2_32_Ceil(Ops.size() + (N->getInt() != 0));
+      return M + 2 <= Width;
+    }
+    case NativeNode::NK_Mul: {
+      unsigned OpM;
+      M = 0;
+      for (auto Op : N->getOps()) {
+        if (!GetMagnitude(Op, Width, Values, OpM))
+          return false;
+        M += OpM;
+      }
+      return M + 2 <= Width;
+    }
+    case NativeNode::NK_Div: {
+      const NativeNode *Divisor = N->getOps()[1];
+      unsigned DivisorM;
+      if (!Divisor->isInt() || Divisor->getInt() == 0 ||
+          !GetMagnitude(Divisor, Width, Values, DivisorM) ||
+          !GetMagnitude(N->getOps()[0], Width, Values, M))
+        return false;
+      return M + 2 <= Width;
+    }
+    case NativeNode::NK_Min:
+    case NativeNode::NK_Max: {
+      unsigned OpM;
+      M = 0;
+      for (auto Op : N->getOps()) {
+        if (!GetMagnitude(Op, Width, Values, OpM))
+          return false;
+        M = std::max(M, OpM);
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+#endif
+
+bool SymbolicRangeAnalysis::isMaterializable(const SymExpr &E,
+                                             IntegerType *Ty,
+                                             IntegerType *EmitTy) const {
+#ifdef SRA_NATIVE_EXPR
+  unsigned M;
+  return IsMaterializable(E.getNode(), Ty, Value_) &&
+         GetMagnitude(E.getNode(), (EmitTy ? EmitTy : Ty)->getBitWidth(),
+                      Value_, M);
+#else
+  SymRange Limits = GetBoundsForTy(Ty, *RangeCtx_);
+  unsigned Width = Ty->getBitWidth();
+  return !E.isMinusInf() && !E.isPlusInf() &&
+         !E.isEQ(Limits.getLower()) && !E.isEQ(Limits.getUpper()) &&
+         !E.isLT(SymExpr(*Ctx_,
+                         APInt::getSignedMinValue(Width).getSExtValue())) &&
+         !E.isGT(SymExpr(*Ctx_,
+                         APInt::getSignedMaxValue(Width).getSExtValue()));
+#endif
+}
+
+#ifdef SRA_NATIVE_EXPR
+// An instruction whose range is a single compound expression computes exactly
+// that expression if it has the operation the expression is emitted with, and
+// neither it nor the values it is computed from may wrap. Others, such as udiv
+// or zext, may have the same range without computing it.
+static bool ComputesNode(Instruction *I, const NativeNode *N) {
+  switch (N->getKind()) {
+    case NativeNode::NK_Add:
+    case NativeNode::NK_Mul:
+      return I->getOpcode() == Instruction::Add ||
+             I->getOpcode() == Instruction::Sub ||
+             I->getOpcode() == Instruction::Mul ||
+             I->getOpcode() == Instruction::Shl;
+    case NativeNode::NK_Div:
+      return I->getOpcode() == Instruction::SDiv;
+    default:
+      return false;
+  }
+}
+
+void SymbolicRangeAnalysis::indexSeeds() const {
+  Seeds_.clear();
+  SeedsSolved_ = SolvedSCCs_.count();
+
+  for (unsigned Idx = 0, E = SCCOf_.size(); Idx != E; ++Idx) {
+    const Slot &S = Slots_[Idx];
+    if (!S.V || !SolvedSCCs_.test(SCCOf_[Idx]) ||
+        S.State.getNode()->Lower != S.State.getNode()->Upper)
+      continue;
+
+    const NativeNode *N = S.State.getNode()->Lower;
+    Instruction *I = dyn_cast<Instruction>(S.V);
+    // Virtual redefinitions are not in the function.
+    if (!I || !I->getParent() || !ComputesNode(I, N) || mayWrap(S.V))
+      continue;
+    Seeds_[N].push_back(I);
+  }
+}
+
+// Returns whether I is available at the insertion point Pt of BB.
+static bool IsAvailableAt(Instruction *I, BasicBlock *BB,
+                          BasicBlock::iterator Pt, DominatorTree *DT) {
+  if (I->getParent() != BB)
+    return DT && DT->dominates(I->getParent(), BB);
+  for (auto It = ++BasicBlock::iterator(I); ; ++It) {
+    if (It == Pt)
+      return true;
+    if (It == BB->end())
+      return false;
+  }
+}
+
+// Seeds the cache with an existing value for N, or else for its operands.
+void SymbolicRangeAnalysis::seedMaterialized(
+    const NativeNode *N, Type *Ty, BasicBlock *BB, BasicBlock::iterator Pt,
+    DominatorTree *DT, SmallPtrSetImpl<const NativeNode*> &Visited) const {
+  if (N->getKind() < NativeNode::NK_Add || !Visited.insert(N).second)
+    return;
+
+  auto Key = std::make_pair(N, Ty);
+  auto Cached = Materialized_.find(Key);
+  if (Cached != Materialized_.end() && Cached->second)
+    return;
+
+  auto It = Seeds_.find(N);
+  if (It != Seeds_.end())
+    for (Value *V : It->second) {
+      if (!V || V->getType() != Ty)
+        continue;
+      Instruction *I = dyn_cast<Instruction>(V);
+      if (I && (!I->getParent() || !IsAvailableAt(I, BB, Pt, DT)))
+        continue;
+      Materialized_[Key] = V;
+      return;
+    }
+
+  for (auto Op : N->getOps())
+    seedMaterialized(Op, Ty, BB, Pt, DT, Visited);
+}
+#endif
+
+void SymbolicRangeAnalysis::createNarrowingFn(Value *LHS, Value *Bound,
                                       CmpInst::Predicate Pred, BasicBlock *BB) {
-  if (auto Redef = RDF_->getRedef(LHS, BB))
-    Fn_[Redef] = [Redef, RHS, Pred, this] ()
-      { return Narrow(Redef, RHS, Pred, this); };
+  if (auto Redef = RDF_->getRedef(LHS, BB)) {
+    Slot &S = Slots_[getIndex(Redef)];
+    S.Kind  = TK_Narrow;
+    S.Bound = Bound;
+    S.Pred  = Pred;
+  }
 }
 
 void SymbolicRangeAnalysis::handleBranch(BranchInst *BI, ICmpInst *ICI) {
+  // Sigmas are found by the values compared, and narrowed against the
+  // definitions that the comparison reads.
   Value *LHS = ICI->getOperand(0), *RHS = ICI->getOperand(1);
+  Value *LHSDef = getDef(ICI->getOperandUse(0)),
+        *RHSDef = getDef(ICI->getOperandUse(1));
   BasicBlock *TB = BI->getSuccessor(0), *FB = BI->getSuccessor(1);
   CmpInst::Predicate Pred     = ICI->getPredicate(),
                      SwapPred = ICI->getSwappedPredicate(),
@@ -366,11 +1037,11 @@ void SymbolicRangeAnalysis::handleBranch(BranchInst *BI, ICmpInst *ICI) {
 
   // For (i < j) branching to cond.true and cond.false, for example:
   // 1) i < j at cond.true;
-  createNarrowingFn(LHS, RHS, Pred,     TB);
+  createNarrowingFn(LHS, RHSDef, Pred,     TB);
   // 2) j > i at cond.true;
-  createNarrowingFn(RHS, LHS, SwapPred, TB);
+  createNarrowingFn(RHS, LHSDef, SwapPred, TB);
   // 3) i >= j at cond.false;
-  createNarrowingFn(LHS, RHS, InvPred,  FB);
+  createNarrowingFn(LHS, RHSDef, InvPred,  FB);
 
   if (ICI->isEquality())
     EqPred = Pred;
@@ -381,115 +1052,914 @@ void SymbolicRangeAnalysis::handleBranch(BranchInst *BI, ICmpInst *ICI) {
     EqPred = (ICmpInst::Predicate)(Pred + 1);
   }
   // 4) j <= i at cond.false;
-  createNarrowingFn(RHS, LHS, EqPred, FB);
+  createNarrowingFn(RHS, LHSDef, EqPred, FB);
 }
 
 void SymbolicRangeAnalysis::handleIntInst(Instruction *I) {
-  setName(I,  makeName(I->getParent()->getParent(), I));
-  //  setState(I, GetBoundsForValue(I, SI_));
-  if (isa<LoadInst>(I))
-    setState(I, SAGEExpr(*SI_, getName(I).c_str()));
-  else
-    setState(I, getBottom());
+  Slot &S = Slots_[getIndex(I)];
   switch (I->getOpcode()) {
     case Instruction::Add:
     case Instruction::Sub:
     case Instruction::Mul:
     case Instruction::SDiv:
     case Instruction::UDiv:
-      Fn_[I] = [I, this] ()
-        { return BinaryOp(cast<BinaryOperator>(I), this); };
+    case Instruction::URem:
+    case Instruction::SRem:
+    case Instruction::Shl:
+    case Instruction::LShr:
+    case Instruction::AShr:
+    case Instruction::And:
+      S.Kind = TK_BinaryOp;
+      break;
+    case Instruction::Select:
+      S.Kind = TK_Select;
       break;
     case Instruction::PHI:
-      if (!Fn_.count(I))
-        Fn_[I] = [I, this] ()
-          { return Meet(cast<PHINode>(I), this); };
+      // Sigma nodes already have a narrowing function.
+      if (S.Kind == TK_None)
+        S.Kind = TK_Meet;
       break;
     case Instruction::Trunc:
     case Instruction::ZExt:
     case Instruction::SExt:
-        Fn_[I] = [I, this] ()
-          { return this->getState(*I->op_begin()); };
+      S.Kind = TK_Cast;
+      break;
+#ifdef SRA_NATIVE_EXPR
+    case Instruction::Call:
+      if (Callees_ && cast<CallInst>(I)->getCalledFunction())
+        S.Kind = TK_Call;
       break;
+#endif
     default:
       return;
   }
 }
 
+// An affine induction variable {Start,+,Step} of a loop whose backedge is
+// taken BTC times holds values between Start and Start + Step * BTC, so its
+// slot is given that range and no transfer function, which also takes it out
+// of the loop's component. The recurrence must not wrap in the signed sense
+// in which ranges are read: either it has no signed wrap, or it has no
+// unsigned wrap, counts up, and starts and ends non-negative.
+void SymbolicRangeAnalysis::handleInductionVar(PHINode *Phi) {
+  Slot &S = Slots_[getIndex(Phi)];
+  if (S.Kind != TK_Meet)
+    return;
+
+  auto AR = dyn_cast<SCEVAddRecExpr>(SE_->getSCEV(Phi));
+  if (!AR || !AR->isAffine() || AR->getLoop()->getHeader() != Phi->getParent())
+    return;
+  auto Step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(*SE_));
+  const SCEV *BTC = SE_->getBackedgeTakenCount(AR->getLoop());
+  if (!Step || Step->getValue()->isZero() || isa<SCEVCouldNotCompute>(BTC) ||
+      BTC->getType() != AR->getType())
+    return;
+
+  const SCEV *Last = AR->evaluateAtIteration(BTC, *SE_);
+  if (!AR->getNoWrapFlags(SCEV::FlagNSW) &&
+      !(AR->getNoWrapFlags(SCEV::FlagNUW) &&
+        !Step->getValue()->isNegative() &&
+        SE_->isKnownNonNegative(AR->getStart()) &&
+        SE_->isKnownNonNegative(Last)))
+    return;
+
+  SymExpr Start = getBottomExpr(), End = getBottomExpr();
+  if (!getSCEVExpr(AR->getStart(), Start) ||
+      !getSCEVExpr(Last, End))
+    return;
+  if (Start.getSize() > MaxExprSize || End.getSize() > MaxExprSize)
+    return;
+
+  SymRange Range = Step->getValue()->isNegative() ? SymRange(End, Start)
+                                                  : SymRange(Start, End);
+  DEBUG(dbgs() << "SRA: induction variable " << S.Name << " = " << Range
+               << "\n");
+  S.Kind  = TK_None;
+  S.State = Range;
+  S.HasStableBounds = S.StableLower = S.StableUpper = true;
+}
+
+// Builds the expression for S out of the symbols of the analysed values.
+bool SymbolicRangeAnalysis::getSCEVExpr(const SCEV *S, SymExpr &Expr) {
+  if (auto C = dyn_cast<SCEVConstant>(S)) {
+    const APInt &Int = C->getValue()->getValue();
+    if (Int.getMinSignedBits() > 64)
+      return false;
+    Expr = SymExpr(*Ctx_, Int.getSExtValue());
+    return true;
+  }
+
+  if (auto U = dyn_cast<SCEVUnknown>(S)) {
+    auto It = Index_.find(U->getValue());
+    if (It == Index_.end())
+      return false;
+    Expr = SymExpr(*Ctx_, Slots_[It->second].Name.c_str());
+    return true;
+  }
+
+  // Sign extension preserves the value.
+  if (auto SE = dyn_cast<SCEVSignExtendExpr>(S))
+    return getSCEVExpr(SE->getOperand(), Expr);
+
+  auto N = dyn_cast<SCEVNAryExpr>(S);
+  if (!N || !(isa<SCEVAddExpr>(N) || isa<SCEVMulExpr>(N) ||
+              isa<SCEVSMaxExpr>(N)))
+    return false;
+
+  if (!getSCEVExpr(N->getOperand(0), Expr))
+    return false;
+  for (unsigned Idx = 1, E = N->getNumOperands(); Idx != E; ++Idx) {
+    SymExpr Op = getBottomExpr();
+    if (!getSCEVExpr(N->getOperand(Idx), Op))
+      return false;
+    if (isa<SCEVAddExpr>(N))
+      Expr = Expr + Op;
+    else if (isa<SCEVMulExpr>(N))
+      Expr = Expr * Op;
+    else
+      Expr = Expr.max(Op);
+  }
+  return true;
+}
+
+SymRange SymbolicRangeAnalysis::evaluate(unsigned Idx) {
+  const Slot &S = Slots_[Idx];
+  switch (S.Kind) {
+    case TK_BinaryOp:
+      return BinaryOp(cast<BinaryOperator>(S.V), this);
+    case TK_Meet:
+      return Meet(cast<PHINode>(S.V), this);
+    case TK_Narrow:
+      return Narrow(cast<PHINode>(S.V), S.Bound,
+                    (CmpInst::Predicate) S.Pred, this);
+    case TK_Cast:
+      return getState(getDef(cast<Instruction>(S.V)->getOperandUse(0)));
+    case TK_Select:
+      return Select(cast<SelectInst>(S.V), this);
+#ifdef SRA_NATIVE_EXPR
+    case TK_Call:
+      return applySummary(cast<CallInst>(S.V));
+#endif
+    default:
+      llvm_unreachable("Value has no transfer function");
+  }
+}
+
+SymRange SymbolicRangeAnalysis::getSummary() {
+  SymRange Ret = getBottom();
+  for (auto &BB : *Function_)
+    if (ReturnInst *RI = dyn_cast<ReturnInst>(BB.getTerminator()))
+      if (RI->getReturnValue()) {
+        SymRange State = getStateOrInf(getDef(RI->getOperandUse(0)));
+        if (Ret == getBottom()) {
+          Ret = State;
+          continue;
+        }
+        Ret.setLower(Ret.getLower().min(State.getLower()));
+        Ret.setUpper(Ret.getUpper().max(State.getUpper()));
+      }
+  return Ret;
+}
+
+#ifdef SRA_NATIVE_EXPR
+// Calls to functions without a solved analysis, such as those in the same
+// call graph SCC, stay at bottom.
+SymRange SymbolicRangeAnalysis::applySummary(CallInst *CI) {
+  Function *Callee = CI->getCalledFunction();
+  auto It = Callees_->find(Callee);
+  if (It == Callees_->end())
+    return getBottom();
+
+  SymbolicRangeAnalysis *CalleeSRA = It->second;
+  SymRange Summary = CalleeSRA->getSummary();
+  if (Summary == CalleeSRA->getBottom())
+    return getBottom();
+
+  StringMap<const NativeRangeNode*> Subst;
+  unsigned ArgNo = 0;
+  for (auto &Arg : Callee->args()) {
+    if (ArgNo == CI->getNumArgOperands())
+      break;
+    // Arguments are the first operands of a call.
+    Value *Actual = getDef(CI->getOperandUse(ArgNo++));
+    if (Arg.getType()->isIntegerTy())
+      Subst[CalleeSRA->getName(&Arg)] = getStateOrInf(Actual).getNode();
+  }
+
+  SymExpr Lower(*Ctx_, Ctx_->substitute(Summary.getLower().getNode(), Subst,
+                                        /*Upper=*/false)),
+          Upper(*Ctx_, Ctx_->substitute(Summary.getUpper().getNode(), Subst,
+                                        /*Upper=*/true));
+  if (Lower.isUndef())
+    Lower = SymExpr::getMinusInf(*Ctx_);
+  if (Upper.isUndef())
+    Upper = SymExpr::getPlusInf(*Ctx_);
+  return SymRange(Lower, Upper);
+}
+#endif
+
 void SymbolicRangeAnalysis::initialize(Function *F) {
+  Slots_.clear();
+  Index_.clear();
+  Value_.clear();
+  Dirty_.clear();
+  MayWrap_.clear();
+#ifdef SRA_NATIVE_EXPR
+  MaterializedAt_ = nullptr;
+  SeedsSolved_ = ~0u;
+#endif
+
   // Create symbols for the function's integer arguments.
   for (auto AI = F->arg_begin(), AE = F->arg_end(); AI != AE; ++AI)
     if (AI->getType()->isIntegerTy()) {
       std::string Name = makeName(F, &(*AI));
-      setName(&(*AI), Name);
-      SAGEExpr Arg(*SI_, Name.c_str());
+      SymExpr Arg(*Ctx_, Name.c_str());
       // Range is symbolic - [Arg, Arg].
-      setState(&(*AI), SAGERange(Arg));
+      addSlot(&(*AI), Name, SymRange(Arg));
     }
 
-  // Create a closure for each instruction.
-  for (auto &BB : *F) {
+  // Visit blocks in reverse post-order, so that definitions are usually
+  // numbered (and thus evaluated) before their uses. Unreachable blocks go
+  // last.
+  std::vector<BasicBlock*> Blocks;
+  SmallPtrSet<BasicBlock*, 32> Visited;
+  ReversePostOrderTraversal<Function*> RPOT(F);
+  for (auto BB : RPOT) {
+    Blocks.push_back(BB);
+    Visited.insert(BB);
+  }
+  for (auto &BB : *F)
+    if (!Visited.count(&BB))
+      Blocks.push_back(&BB);
+
+  // Number every integer instruction, so that transfer functions created for
+  // sigma nodes can refer to blocks that haven't been visited yet. Virtual
+  // redefinitions stand at the start of their blocks.
+  for (auto BB : Blocks) {
+    for (auto Phi : RDF_->getVirtualRedefs(BB))
+      addSlot(Phi, makeName(F, Phi), getBottom());
+    for (auto &I : *BB)
+      if (I.getType()->isIntegerTy()) {
+        std::string Name = makeName(F, &I);
+        if (isa<LoadInst>(I))
+          addSlot(&I, Name, SymExpr(*Ctx_, Name.c_str()));
+        else
+          addSlot(&I, Name, getBottom());
+      }
+  }
+
+  // Create a transfer function for each instruction.
+  for (auto BB : Blocks) {
     // Handle sigma nodes.
-    TerminatorInst *TI = BB.getTerminator();
+    TerminatorInst *TI = BB->getTerminator();
     if (BranchInst *BI = dyn_cast<BranchInst>(TI))
       if (BI->isConditional())
         if (ICmpInst *ICI = dyn_cast<ICmpInst>(BI->getCondition()))
           handleBranch(BI, ICI);
 
     // Handle everything that's not a sigma node.
-    for (auto &I : BB)
-      if (I.getType()->isIntegerTy()) {
-        Mapping_[&I] = Mapping_.size() + 1;
+    for (auto Phi : RDF_->getVirtualRedefs(BB))
+      handleIntInst(Phi);
+    for (auto &I : *BB)
+      if (I.getType()->isIntegerTy())
         handleIntInst(&I);
+  }
+
+  if (SE_ && UseInductionVars)
+    for (auto BB : Blocks)
+      for (auto &I : *BB) {
+        PHINode *Phi = dyn_cast<PHINode>(&I);
+        if (!Phi)
+          break;
+        if (Phi->getType()->isIntegerTy())
+          handleInductionVar(Phi);
       }
+
+  buildGraph();
+  buildSCCs();
+  SolvedSCCs_.clear();
+  SolvedSCCs_.resize(SCCBegin_.size() - 1);
+
+  Worklist_.resize(Slots_.size());
+  Worklist_.clear();
+  Evaled_.resize(Slots_.size());
+}
+
+void SymbolicRangeAnalysis::notifyChanged(Value *V) {
+  Instruction *I = dyn_cast<Instruction>(V);
+  if (I && isa<TerminatorInst>(I)) {
+    invalidate(I->getParent());
+    return;
   }
+
+  // Comparisons feed the narrowing functions of the branches using them.
+  if (isa<ICmpInst>(V))
+    for (auto U : V->users())
+      if (isa<BranchInst>(U))
+        invalidate(cast<BranchInst>(U)->getParent());
+
+  markChanged(V);
 }
 
-void SymbolicRangeAnalysis::reset(Function *F) {
-  for (auto &BB : *F)
-    for (auto &I : BB)
-      if (Changed_.count(&I) && Changed_[&I])
-        Worklist_.insert(std::make_pair(Mapping_[&I], &I));
+void SymbolicRangeAnalysis::markChanged(Value *V) {
+  if (!V->getType()->isIntegerTy())
+    return;
+
+  Instruction *I = dyn_cast<Instruction>(V);
+  unsigned Idx;
+  auto It = Index_.find(V);
+  if (It == Index_.end()) {
+    Function *F = I ? I->getParent()->getParent()
+                    : cast<Argument>(V)->getParent();
+    std::string Name = makeName(F, V);
+    if (isa<LoadInst>(V) || isa<Argument>(V))
+      Idx = addSlot(V, Name, SymExpr(*Ctx_, Name.c_str()));
+    else
+      Idx = addSlot(V, Name, getBottom());
+  } else {
+    Idx = It->second;
+  }
+  Dirty_.push_back(Idx);
+
+  // Sigma nodes keep the narrowing function given by their branch.
+  Slot &S = Slots_[Idx];
+  if (I && S.Kind != TK_Narrow) {
+    S.Kind = TK_None;
+    handleIntInst(I);
+  }
+}
+
+void SymbolicRangeAnalysis::invalidate(BasicBlock *BB) {
+  for (auto &I : *BB)
+    markChanged(&I);
+
+  // Rebuild the narrowing functions of the sigma nodes in the successors,
+  // which are only reached through BB.
+  std::vector<PHINode*> Sigmas;
+  TerminatorInst *TI = BB->getTerminator();
+  for (unsigned Idx = 0, E = TI->getNumSuccessors(); Idx != E; ++Idx) {
+    BasicBlock *Succ = TI->getSuccessor(Idx);
+    if (Succ->getSinglePredecessor() != BB)
+      continue;
+    for (auto Phi : RDF_->getVirtualRedefs(Succ))
+      Sigmas.push_back(Phi);
+    for (auto &I : *Succ) {
+      PHINode *Phi = dyn_cast<PHINode>(&I);
+      if (!Phi)
+        break;
+      if (Phi->getType()->isIntegerTy())
+        Sigmas.push_back(Phi);
+    }
+  }
+
+  for (auto Phi : Sigmas) {
+    markChanged(Phi);
+    Slot &S = Slots_[getIndex(Phi)];
+    S.Kind  = TK_None;
+    S.Bound = nullptr;
+  }
 
-  Evaled_.clear();
-  Changed_.clear();
+  if (BranchInst *BI = dyn_cast<BranchInst>(TI))
+    if (BI->isConditional())
+      if (ICmpInst *ICI = dyn_cast<ICmpInst>(BI->getCondition()))
+        handleBranch(BI, ICI);
+
+  for (auto Phi : Sigmas)
+    handleIntInst(Phi);
 }
 
-void SymbolicRangeAnalysis::iterate(Function *F) {
+void SymbolicRangeAnalysis::forget(Value *V) {
+  auto It = Index_.find(V);
+  if (It == Index_.end())
+    return;
+
+  // Users lose an operand; the slot itself is left behind as a tombstone,
+  // without operands.
+  unsigned Idx = It->second;
+  if (Idx < UsersBegin_.size())
+    for (auto User : getUsers(Idx))
+      Dirty_.push_back(User);
+  Dirty_.push_back(Idx);
+
+  Slot &S = Slots_[Idx];
+  Value_.erase(S.Name);
+  Index_.erase(It);
+  S.V     = nullptr;
+  S.Bound = nullptr;
+  S.Kind  = TK_None;
+  S.State = getBottom();
+}
+
+// Applies the pending updates: the rows of the graph read by the dirty slots
+// are replaced, and the dirty slots and their transitive users, which are the
+// only ones whose components may change, are reset and given new components.
+void SymbolicRangeAnalysis::update() {
+  DEBUG(dbgs() << "SRA: update: " << Dirty_.size() << " dirty slots\n");
+  MayWrap_.clear();
+#ifdef SRA_NATIVE_EXPR
+  // The function no longer matches its cache key, and values emitted for
+  // previous states may no longer be their bounds.
+  CacheKey_.clear();
+  MaterializedAt_ = nullptr;
+  SeedsSolved_ = ~0u;
+#endif
+  unsigned NumSlots = Slots_.size(), OldSlots = SCCOf_.size();
+
+  std::vector<unsigned> Dirty;
+  Dirty.swap(Dirty_);
+  std::sort(Dirty.begin(), Dirty.end());
+  Dirty.erase(std::unique(Dirty.begin(), Dirty.end()), Dirty.end());
+  updateGraph(Dirty);
+
+  std::vector<unsigned> Affected, Stack(Dirty.begin(), Dirty.end());
+  DenseSet<unsigned> Visited;
+  while (!Stack.empty()) {
+    unsigned Idx = Stack.back();
+    Stack.pop_back();
+    if (!Visited.insert(Idx).second)
+      continue;
+    Affected.push_back(Idx);
+    for (auto User : getUsers(Idx))
+      Stack.push_back(User);
+  }
+  std::sort(Affected.begin(), Affected.end());
+
+  for (auto Idx : Affected) {
+    Slot &S = Slots_[Idx];
+    if (S.Kind != TK_None)
+      S.State = getBottom();
+    S.Changed = 0;
+    S.HasStableBounds = S.StableLower = S.StableUpper = false;
+    if (Idx < OldSlots)
+      SolvedSCCs_.set(SCCOf_[Idx]);
+  }
+
+  unsigned FirstNew = SCCBegin_.size() - 1;
+  SCCOf_.resize(NumSlots);
+  appendSCCs(Affected);
+  SolvedSCCs_.resize(SCCBegin_.size() - 1, false);
+
+  // Once most members belong to components left behind, the components are
+  // rebuilt; those whose members are all solved stay solved.
+  if (SCCMembers_.size() > 2 * NumSlots) {
+    BitVector Solved(NumSlots);
+    for (unsigned Idx = 0; Idx < NumSlots; ++Idx)
+      if (SolvedSCCs_.test(SCCOf_[Idx]))
+        Solved.set(Idx);
+
+    buildSCCs();
+    SolvedSCCs_.clear();
+    SolvedSCCs_.resize(SCCBegin_.size() - 1, true);
+    for (unsigned Idx = 0; Idx < NumSlots; ++Idx)
+      if (!Solved.test(Idx))
+        SolvedSCCs_.reset(SCCOf_[Idx]);
+    FirstNew = 0;
+  }
+
+  // The worklist is empty between solves.
+  Worklist_.resize(NumSlots);
+  Evaled_.resize(NumSlots);
+
+  if (!Lazy)
+    for (unsigned SCC = FirstNew; SCC + 1 < SCCBegin_.size(); ++SCC)
+      if (!SolvedSCCs_.test(SCC))
+        solveSCC(SCC);
+}
+
+void SymbolicRangeAnalysis::getTransferOperands(
+    unsigned Idx, SmallVectorImpl<Value*> &Ops) const {
+  const Slot &S = Slots_[Idx];
+  switch (S.Kind) {
+    case TK_BinaryOp:
+    case TK_Cast:
+      for (auto &Op : cast<User>(S.V)->operands())
+        Ops.push_back(getDef(Op));
+      break;
+    case TK_Meet:
+      getIncomingDefs(cast<PHINode>(S.V), Ops);
+      break;
+    case TK_Narrow:
+      getIncomingDefs(cast<PHINode>(S.V), Ops);
+      Ops.push_back(S.Bound);
+      break;
+    case TK_Select:
+      Ops.push_back(getDef(cast<SelectInst>(S.V)->getOperandUse(1)));
+      Ops.push_back(getDef(cast<SelectInst>(S.V)->getOperandUse(2)));
+      break;
+    case TK_Call:
+      for (auto &Op : cast<CallInst>(S.V)->arg_operands())
+        Ops.push_back(getDef(Op));
+      break;
+    default:
+      break;
+  }
+}
+
+void SymbolicRangeAnalysis::buildGraph() {
+  unsigned NumSlots = Slots_.size();
+  OpsBegin_.assign(NumSlots, 0);
+  OpsEnd_.assign(NumSlots, 0);
+  Ops_.clear();
+  UsersBegin_.assign(NumSlots, 0);
+  UsersEnd_.assign(NumSlots, 0);
+  Users_.clear();
+
+  SmallVector<Value*, 4> Operands;
+  for (unsigned Idx = 0; Idx < NumSlots; ++Idx) {
+    OpsBegin_[Idx] = Ops_.size();
+    Operands.clear();
+    getTransferOperands(Idx, Operands);
+    for (auto Op : Operands) {
+      auto It = Index_.find(Op);
+      if (It != Index_.end()) {
+        Ops_.push_back(It->second);
+        ++UsersEnd_[It->second];
+      }
+    }
+    OpsEnd_[Idx] = Ops_.size();
+  }
+  NumEdges_ = Ops_.size();
+
+  // Invert the operand lists into user lists.
+  unsigned Begin = 0;
+  for (unsigned Idx = 0; Idx < NumSlots; ++Idx) {
+    UsersBegin_[Idx] = Begin;
+    Begin += UsersEnd_[Idx];
+    UsersEnd_[Idx] = UsersBegin_[Idx];
+  }
+  Users_.resize(Ops_.size());
+  for (unsigned Idx = 0; Idx < NumSlots; ++Idx)
+    for (auto Op : getOperands(Idx))
+      Users_[UsersEnd_[Op]++] = Idx;
+}
+
+// Gives each dirty slot a new operand row, and each of its old and new
+// operands a new user row, at the end of the arrays.
+void SymbolicRangeAnalysis::updateGraph(ArrayRef<unsigned> Dirty) {
+  unsigned NumSlots = Slots_.size();
+  OpsBegin_.resize(NumSlots, 0);
+  OpsEnd_.resize(NumSlots, 0);
+  UsersBegin_.resize(NumSlots, 0);
+  UsersEnd_.resize(NumSlots, 0);
+
+  // The dirty users that each operand gains, for every operand whose user
+  // row changes.
+  DenseMap<unsigned, SmallVector<unsigned, 4> > NewUsers;
+  DenseSet<unsigned> IsDirty(Dirty.begin(), Dirty.end());
+
+  SmallVector<Value*, 4> Operands;
+  for (auto Idx : Dirty) {
+    for (auto Op : getOperands(Idx))
+      NewUsers[Op];
+    NumEdges_ -= OpsEnd_[Idx] - OpsBegin_[Idx];
+
+    OpsBegin_[Idx] = Ops_.size();
+    Operands.clear();
+    getTransferOperands(Idx, Operands);
+    for (auto Op : Operands) {
+      auto It = Index_.find(Op);
+      if (It != Index_.end()) {
+        Ops_.push_back(It->second);
+        NewUsers[It->second].push_back(Idx);
+      }
+    }
+    OpsEnd_[Idx] = Ops_.size();
+    NumEdges_ += OpsEnd_[Idx] - OpsBegin_[Idx];
+  }
+
+  for (auto &Entry : NewUsers) {
+    unsigned Op = Entry.first, Begin = Users_.size();
+    for (unsigned Pos = UsersBegin_[Op]; Pos != UsersEnd_[Op]; ++Pos) {
+      unsigned User = Users_[Pos];
+      if (!IsDirty.count(User))
+        Users_.push_back(User);
+    }
+    Users_.insert(Users_.end(), Entry.second.begin(), Entry.second.end());
+    UsersBegin_[Op] = Begin;
+    UsersEnd_[Op] = Users_.size();
+  }
+
+  if (Ops_.size() + Users_.size() > 4 * NumEdges_ + NumSlots)
+    buildGraph();
+}
+
+// Tarjan's algorithm over operand edges, which emits components after all of
+// the components they read from, i.e. in topological order.
+void SymbolicRangeAnalysis::buildSCCs() {
+  unsigned NumSlots = Slots_.size();
+  SCCBegin_.assign(1, 0);
+  SCCMembers_.clear();
+  SCCOf_.assign(NumSlots, 0);
+  CyclicSCCs_.clear();
+
+  std::vector<unsigned> All(NumSlots);
+  for (unsigned Idx = 0; Idx < NumSlots; ++Idx)
+    All[Idx] = Idx;
+  appendSCCs(All);
+}
+
+// Finds the components among the slots of Region, and appends them after the
+// existing ones. Operands outside of Region must already have a component.
+void SymbolicRangeAnalysis::appendSCCs(ArrayRef<unsigned> Region) {
+  unsigned NumSlots = Slots_.size();
+  SCCNum_.resize(NumSlots, ~0u);
+  SCCLow_.resize(NumSlots, 0);
+  SCCOnStack_.resize(NumSlots);
+  for (auto Idx : Region)
+    SCCNum_[Idx] = 0;
+
+  std::vector<unsigned> &Num = SCCNum_, &Low = SCCLow_, Stack;
+  std::vector<std::pair<unsigned, unsigned> > CallStack;
+  BitVector &OnStack = SCCOnStack_;
+  unsigned NextNum = 1;
+
+  for (auto Root : Region) {
+    if (Num[Root])
+      continue;
+
+    Num[Root] = Low[Root] = NextNum++;
+    Stack.push_back(Root);
+    OnStack.set(Root);
+    CallStack.push_back(std::make_pair(Root, 0));
+
+    while (!CallStack.empty()) {
+      unsigned Idx = CallStack.back().first;
+      auto Operands = getOperands(Idx);
+      if (CallStack.back().second < Operands.size()) {
+        unsigned Op = Operands[CallStack.back().second++];
+        if (Num[Op] == ~0u)
+          continue;
+        if (!Num[Op]) {
+          Num[Op] = Low[Op] = NextNum++;
+          Stack.push_back(Op);
+          OnStack.set(Op);
+          CallStack.push_back(std::make_pair(Op, 0));
+        } else if (OnStack.test(Op)) {
+          Low[Idx] = std::min(Low[Idx], Num[Op]);
+        }
+        continue;
+      }
+
+      CallStack.pop_back();
+      if (!CallStack.empty()) {
+        unsigned Parent = CallStack.back().first;
+        Low[Parent] = std::min(Low[Parent], Low[Idx]);
+      }
+      if (Low[Idx] != Num[Idx])
+        continue;
+
+      unsigned SCC = SCCBegin_.size() - 1, Member;
+      bool IsCyclic = false;
+      do {
+        Member = Stack.back();
+        Stack.pop_back();
+        OnStack.reset(Member);
+        SCCMembers_.push_back(Member);
+        SCCOf_[Member] = SCC;
+        IsCyclic = IsCyclic || Member != Idx;
+      } while (Member != Idx);
+      for (auto Op : getOperands(Idx))
+        IsCyclic = IsCyclic || Op == Idx;
+
+      std::sort(SCCMembers_.begin() + SCCBegin_.back(), SCCMembers_.end());
+      SCCBegin_.push_back(SCCMembers_.size());
+      CyclicSCCs_.resize(SCC + 1, IsCyclic);
+    }
+  }
+
+  for (auto Idx : Region)
+    Num[Idx] = ~0u;
+}
+
+// Solve components in topological order, so that every operand outside of a
+// component holds its final state by the time the component is solved.
+void SymbolicRangeAnalysis::solve() {
+  for (unsigned SCC = 0; SCC + 1 < SCCBegin_.size(); ++SCC)
+    if (!SolvedSCCs_.test(SCC))
+      solveSCC(SCC);
+
+#ifdef SRA_NATIVE_EXPR
+  if (!CacheKey_.empty())
+    storeCached();
+#endif
+}
+
+// Solve the unsolved components in the backward slice of slot Idx.
+void SymbolicRangeAnalysis::demand(unsigned Idx) {
+  DEBUG(dbgs() << "SRA: demand: " << Slots_[Idx].Name << "\n");
+  SmallVector<unsigned, 16> Stack, Slice;
+  BitVector Visited(SCCBegin_.size() - 1);
+
+  Stack.push_back(Idx);
+  while (!Stack.empty()) {
+    unsigned SCC = SCCOf_[Stack.pop_back_val()];
+    if (SolvedSCCs_.test(SCC) || Visited.test(SCC))
+      continue;
+    Visited.set(SCC);
+    Slice.push_back(SCC);
+    for (auto Member : getSCCMembers(SCC))
+      for (auto Op : getOperands(Member))
+        Stack.push_back(Op);
+  }
+
+  // Components are numbered topologically.
+  std::sort(Slice.begin(), Slice.end());
+  for (auto SCC : Slice)
+    solveSCC(SCC);
+}
+
+// Acyclic components are evaluated exactly once. Cyclic ones are iterated in
+// rounds, each of which evaluates every queued member at most once. Bounds
+// still changing after MaxRounds rounds are widened, first to thresholds
+// taken from the component's comparisons, and, once every threshold had its
+// round, to -oo/+oo. Widened components are then narrowed.
+void SymbolicRangeAnalysis::solveSCC(unsigned SCC) {
+  DEBUG(dbgs() << "SRA: solveSCC: " << SCC << "\n");
+  auto Members = getSCCMembers(SCC);
+
+  // Members read each other's intermediate states while being solved.
+  SolvedSCCs_.set(SCC);
+
+  if (!CyclicSCCs_.test(SCC)) {
+    if (Slots_[Members[0]].Kind != TK_None)
+      setState(Members[0], evaluate(Members[0]));
+    return;
+  }
+
+  std::vector<SymExpr> Thresholds;
+  if (UseThresholds)
+    getThresholds(Members, Thresholds);
+
+  for (auto Idx : Members)
+    Worklist_.push(Idx);
+
+  std::vector<SymRange> Prev;
+  bool Widened = false;
+  for (unsigned Round = 1; ; ++Round) {
+    Prev.clear();
+    for (auto Idx : Members) {
+      Evaled_.reset(Idx);
+      Slots_[Idx].Changed = 0;
+      Prev.push_back(Slots_[Idx].State);
+    }
+
+    iterate(SCC);
+
+    bool Converged = true;
+    for (auto Idx : Members)
+      Converged = Converged && !Slots_[Idx].Changed;
+    if (Converged)
+      break;
+
+    if (Round >= MaxRounds) {
+      bool Last = Round - MaxRounds >= Thresholds.size();
+      widen(Members, Prev,
+            Last ? ArrayRef<SymExpr>() : ArrayRef<SymExpr>(Thresholds));
+      Widened = true;
+      if (Last)
+        break;
+    }
+
+    for (auto Idx : Members)
+      if (Slots_[Idx].Changed)
+        Worklist_.push(Idx);
+  }
+
+  if (Widened)
+    narrow(Members);
+}
+
+void SymbolicRangeAnalysis::iterate(unsigned SCC) {
   DEBUG(dbgs() << "SRA: Iterate\n");
   while (!Worklist_.empty()) {
-    auto Next = Worklist_.begin();
-    Instruction *I = Next->second;
-    Worklist_.erase(Next);
-    if (Fn_.count(I) && !Evaled_.count(I)) {
-      Evaled_.insert(I);
-      setState(I, Fn_[I]());
-      for (auto UI = I->use_begin(), UE = I->use_end(); UI != UE; ++UI)
-        if (Instruction *Use = dyn_cast<Instruction>(*UI))
-          if (!Evaled_.count(Use))
-            Worklist_.insert(std::make_pair(Mapping_[Use], Use));
+    unsigned Idx = Worklist_.pop();
+    if (Slots_[Idx].Kind == TK_None || Evaled_.test(Idx))
+      continue;
+
+    Evaled_.set(Idx);
+    setState(Idx, evaluate(Idx));
+    if (!Slots_[Idx].Changed)
+      continue;
+
+    for (auto User : getUsers(Idx))
+      if (SCCOf_[User] == SCC && !Evaled_.test(User))
+        Worklist_.push(User);
+  }
+}
+
+// The bounds of the values that the component's sigmas are compared against,
+// off by one either way to match strict comparisons.
+void SymbolicRangeAnalysis::getThresholds(ArrayRef<unsigned> Members,
+                                          std::vector<SymExpr> &Thresholds) {
+  for (auto Idx : Members) {
+    const Slot &S = Slots_[Idx];
+    if (S.Kind != TK_Narrow)
+      continue;
+    // Bounds computed by the component itself are not known yet.
+    auto It = Index_.find(S.Bound);
+    if (It != Index_.end() && SCCOf_[It->second] == SCCOf_[Idx])
+      continue;
+
+    auto Range = getStateOrInf(S.Bound);
+    if (Range == getBottom())
+      continue;
+    SymExpr Bounds[] = { Range.getLower(), Range.getUpper() };
+    for (auto &Bound : Bounds) {
+      if (Bound.isMinusInf() || Bound.isPlusInf())
+        continue;
+      SymExpr Candidates[] = { Bound - 1, Bound, Bound + 1 };
+      for (auto &T : Candidates)
+        if (std::find(Thresholds.begin(), Thresholds.end(), T) ==
+            Thresholds.end())
+          Thresholds.push_back(T);
     }
   }
+  DEBUG(dbgs() << "SRA: " << Thresholds.size() << " widening thresholds\n");
 }
 
-void SymbolicRangeAnalysis::widen(Function *F) {
+// A bound that moved past its state before the round (Prev) is widened to the
+// closest threshold known to lie beyond it, or to the type's bound. One that
+// stayed within it keeps the previous state.
+void SymbolicRangeAnalysis::widen(ArrayRef<unsigned> Members,
+                                  ArrayRef<SymRange> Prev,
+                                  ArrayRef<SymExpr> Thresholds) {
   DEBUG(dbgs() << "SRA: Widen\n");
-  for (auto &BB : *F)
-    for (auto &I : BB)
-      if (I.getType()->isIntegerTy())
-        if (Changed_.count(&I) && Changed_[&I]) {
-          auto State = getStateOrInf(&I);
-          auto Bounds = GetBoundsForValue(&I, SI_);
-          if (Changed_[&I] & CHANGED_LOWER)
-            State.setLower(Bounds.getLower());
-          if (Changed_[&I] & CHANGED_UPPER)
-            State.setUpper(Bounds.getUpper());
-          setState(&I, State);
-        }
+  for (unsigned I = 0, E = Members.size(); I != E; ++I) {
+    unsigned Idx = Members[I];
+    unsigned Changed = Slots_[Idx].Changed;
+    if (!Changed)
+      continue;
+    auto State = getStateOrInf(Slots_[Idx].V);
+    auto Bounds = GetBoundsForValue(Slots_[Idx].V, *RangeCtx_);
+    bool HasPrev = !Thresholds.empty() && Prev[I] != getBottom();
+
+    if (Changed & CHANGED_LOWER) {
+      SymExpr Lower = State.getLower();
+      if (HasPrev && Lower.isGE(Prev[I].getLower())) {
+        State.setLower(Prev[I].getLower());
+      } else {
+        const SymExpr *Best = nullptr;
+        for (auto &T : Thresholds)
+          if (T.isLE(Lower) && (!Best || Best->isLT(T)))
+            Best = &T;
+        State.setLower(Best ? *Best : Bounds.getLower());
+      }
+    }
+
+    if (Changed & CHANGED_UPPER) {
+      SymExpr Upper = State.getUpper();
+      if (HasPrev && Upper.isLE(Prev[I].getUpper())) {
+        State.setUpper(Prev[I].getUpper());
+      } else {
+        const SymExpr *Best = nullptr;
+        for (auto &T : Thresholds)
+          if (T.isGE(Upper) && (!Best || Best->isGT(T)))
+            Best = &T;
+        State.setUpper(Best ? *Best : Bounds.getUpper());
+      }
+    }
+    setState(Idx, State);
+  }
+}
+
+// Descending rounds from the widened states: members are evaluated again, so
+// that the Narrow functions of the loop's comparisons bound what widening
+// gave up on, and only bounds known to be tighter are kept. Stability flags
+// are left alone, as they describe the ascending iteration.
+void SymbolicRangeAnalysis::narrow(ArrayRef<unsigned> Members) {
+  DEBUG(dbgs() << "SRA: Narrow\n");
+  for (unsigned Round = 0; Round < NarrowingRounds; ++Round) {
+    bool Changed = false;
+    for (auto Idx : Members) {
+      Slot &S = Slots_[Idx];
+      if (S.Kind == TK_None || S.State == getBottom())
+        continue;
+      auto New = evaluate(Idx);
+      if (New == getBottom())
+        continue;
+
+      auto State = S.State;
+      if (New.getLower().getSize() <= MaxExprSize &&
+          New.getLower().isGT(State.getLower()))
+        State.setLower(New.getLower());
+      if (New.getUpper().getSize() <= MaxExprSize &&
+          New.getUpper().isLT(State.getUpper()))
+        State.setUpper(New.getUpper());
+
+      if (State != S.State) {
+        DEBUG(dbgs() << "SRA: narrowed " << S.Name << " to " << State << "\n");
+        S.State = State;
+        Changed = true;
+      }
+    }
+    if (!Changed)
+      break;
+  }
 }
 
 void SymbolicRangeAnalysis::print(raw_ostream &OS, const Module*) const {
-  for (auto P : State_)
-    OS << "[[" << getName(P.first) << "]] = " << P.second << "\n";
+  for (auto &S : Slots_)
+    if (S.V)
+      OS << "[[" << S.Name << "]] = " << getState(S.V) << "\n";
 }
 
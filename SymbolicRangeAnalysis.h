@@ -1,79 +1,301 @@
 #ifndef _SYMBOLICRANGEANALYSIS_H_
 #define _SYMBOLICRANGEANALYSIS_H_
 
-#include "SAGE/SAGEInterface.h"
+#include "SymbolicExpr.h"
 
 #include "Redefinition.h"
-
-#include "SAGE/SAGEExpr.h"
-#include "SAGE/SAGERange.h"
+#include "SlotWorklist.h"
 
 #include "llvm/Pass.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/ValueHandle.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <map>
-#include <set>
+#include <memory>
+#include <vector>
 
 using namespace llvm;
 
+// Per-analysis state that transfer functions build expressions from. Every
+// analysis has its own, so analyses of different functions can run
+// concurrently, and their results do not depend on the order in which
+// functions are analysed.
+struct SymbolicRangeContext {
+  explicit SymbolicRangeContext(SymContext &Ctx);
+
+  SymContext &Ctx;
+  SymExpr     BottomExpr;
+  SymRange    Bottom;
+  SymRange    InfRange;
+  unsigned    NextTemp;
+};
+
 class SymbolicRangeAnalysis : public FunctionPass {
 public:
   static char ID;
-  SymbolicRangeAnalysis() : FunctionPass(ID) { }
+  SymbolicRangeAnalysis() : FunctionPass(ID), Function_(nullptr),
+                            SE_(nullptr), Callees_(nullptr) { }
 
   virtual void getAnalysisUsage(AnalysisUsage &AU) const;
   virtual bool runOnFunction(Function&);
   virtual void print(raw_ostream &OS, const Module*) const;
 
-  SAGEExpr  getBottomExpr() const;
-  SAGERange getBottom() const;
+  SymExpr  getBottomExpr() const;
+  SymRange getBottom() const;
 
   std::string makeName(Function *F, Value *V);
   void        setName(Value *V, std::string Name);
   std::string getName(Value *V) const;
 
-  void      setState(Value *V, SAGERange Range);
-  SAGERange getState(Value *V)      const;
-  SAGERange getStateOrInf(Value *V) const;
+  void     setState(Value *V, SymRange Range);
+  void     setState(unsigned Idx, SymRange Range);
+  SymRange getState(Value *V)      const;
+  SymRange getStateOrInf(Value *V) const;
+
+  // The definition read by U, or the definitions merged by Phi: with
+  // -redef-virtual, those are the redefinitions that reach the user, rather
+  // than the values in the IR.
+  Value *getDef(const Use &U) const;
+  void   getIncomingDefs(PHINode *Phi, SmallVectorImpl<Value*> &Defs) const;
+
+  // Ranges are computed with exact, signed arithmetic. They only hold for V
+  // if none of the values it is computed from wraps around or is truncated:
+  // arithmetic that may wrap must be nsw, truncations and zero extensions
+  // must keep their operand's range, and unsigned comparisons may only
+  // narrow non-negative values. Clients that rely on a range to change the
+  // program must check that V may not wrap.
+  bool mayWrap(Value *V) const;
+
+  // Emits the bounds of V at the insertion point of IRB, as values of EmitTy
+  // if given, or else of the type of V. With the native backend,
+  // subexpressions already emitted at the same point are reused, as are
+  // existing values known to equal them that dominate the point: those in the
+  // same block, or anywhere if DT is given.
+  std::pair<Value*, Value*>
+      getRangeValuesFor(Value *V, IRBuilder<> IRB,
+                        DominatorTree *DT = nullptr,
+                        IntegerType *EmitTy = nullptr) const;
+
+  // Returns whether E, a bound of a value of Ty, can be emitted as a value of
+  // EmitTy (Ty if not given) that it stands for: it must be finite, fit the
+  // signed range of Ty, and not name the type limits that stand for unknown
+  // values. With the native backend, none of the operations it is emitted
+  // with may overflow EmitTy either, which a type wider than Ty makes room
+  // for.
+  bool isMaterializable(const SymExpr &E, IntegerType *Ty,
+                        IntegerType *EmitTy = nullptr) const;
 
-  std::pair<Value*, Value*> getRangeValuesFor(Value *V, IRBuilder<> IRB) const;
+  // Builds the slot table for F outside of a pass manager. Ranges are then
+  // computed by solve, or on demand by queries if isDemandDriven. With the
+  // native backend, Ctx may be null, in which case the analysis creates its
+  // own expression context. If SE is given, affine induction variables get
+  // closed-form ranges instead of being iterated.
+  void prepare(Function &F, Redefinition *RDF, SymContext *Ctx,
+               ScalarEvolution *SE = nullptr);
+  bool isDemandDriven() const;
+  unsigned getNumSlots() const { return Slots_.size(); }
+
+  // Incremental updates after the analysed function is edited. Slots whose
+  // transfer function changed, and their transitive users, restart from
+  // bottom and are solved again; every other slot keeps its state. Updates
+  // are batched and applied by the next query, at a cost proportional to the
+  // slots they reset and their operands, rather than to the function.
+  //
+  // notifyChanged: V was created, or its opcode or operands changed.
+  // invalidate:    every instruction in BB changed, as did its terminator
+  //                and, with it, the sigmas narrowed by its branch.
+  // forget:        V is about to be erased.
+  void notifyChanged(Value *V);
+  void invalidate(BasicBlock *BB);
+  void forget(Value *V);
+
+  // Interprocedural summaries. The summary of a function is the range of
+  // its return value, in terms of the symbols of its integer arguments. Once
+  // setCallees is given the solved analyses of the callees, calls to them are
+  // evaluated by instantiating their summaries with the ranges of the actual
+  // arguments (native backend only). It must be called before prepare.
+  typedef DenseMap<Function*, SymbolicRangeAnalysis*> CalleeMap;
+  void setCallees(const CalleeMap *Callees) { Callees_ = Callees; }
+  SymRange getSummary();
 
   void initialize(Function *F);
-  void reset(Function *F);
-  void iterate(Function *F);
-  void widen(Function *F);
+  void handleInductionVar(PHINode *Phi);
+  void solve();
+  void demand(unsigned Idx);
+  void solveSCC(unsigned SCC);
+  void iterate(unsigned SCC);
+  void getThresholds(ArrayRef<unsigned> Members,
+                     std::vector<SymExpr> &Thresholds);
+  void widen(ArrayRef<unsigned> Members, ArrayRef<SymRange> Prev,
+             ArrayRef<SymExpr> Thresholds);
+  void narrow(ArrayRef<unsigned> Members);
 
   void handleIntInst(Instruction *I);
   void handleBranch(BranchInst *BI, ICmpInst *ICI);
 
-  void createNarrowingFn(Value *LHS, Value *RHS,
+  void createNarrowingFn(Value *LHS, Value *Bound,
                          CmpInst::Predicate Pred, BasicBlock *BB);
 
   bool hasStableLowerBound(Value *V) const;
   bool hasStableUpperBound(Value *V) const;
 
-  void setChanged(Value *V, SAGERange &Prev, SAGERange &New);
+  void setChanged(unsigned Idx, const SymRange &Prev, const SymRange &New);
 
-  SAGEInterface &getSI() { return *SI_; }
+  SymContext &getContext() { return *Ctx_; }
+  const SymbolicRangeContext &getRangeContext() const { return *RangeCtx_; }
 
 private:
-  Module *Module_;
-  SAGEInterface *SI_;
-  Redefinition  *RDF_;
+  // Transfer functions, evaluated by evaluate.
+  enum TransferKind {
+    TK_None,     // The state is fixed (arguments, loads, unhandled opcodes).
+    TK_BinaryOp, // BinaryOp over the operands of a BinaryOperator.
+    TK_Meet,     // Meet over the incoming values of a phi.
+    TK_Narrow,   // Narrow a sigma against Bound, according to Pred.
+    TK_Cast,     // Copy the state of the operand of an integer cast.
+    TK_Call,     // Instantiate the summary of the callee.
+    TK_Select    // Min, max or meet of the values of a select.
+  };
+
+  // Analysis state of a single integer value. Slots are numbered in the order
+  // in which values are visited by initialize (arguments, then instructions
+  // in reverse post-order), which also orders the worklist.
+  struct Slot {
+    Slot(Value *V, std::string Name, SymRange State, unsigned Changed)
+        : V(V), Bound(nullptr), Name(Name), State(State), Kind(TK_None),
+          Pred(CmpInst::BAD_ICMP_PREDICATE), Changed(Changed),
+          HasStableBounds(false), StableLower(false), StableUpper(false) { }
+
+    Value      *V;
+    Value      *Bound;
+    std::string Name;
+    SymRange    State;
+    unsigned    Kind            : 3;
+    unsigned    Pred            : 6;
+    unsigned    Changed         : 2;
+    unsigned    HasStableBounds : 1;
+    unsigned    StableLower     : 1;
+    unsigned    StableUpper     : 1;
+  };
+
+  SymRange evaluate(unsigned Idx);
+#ifdef SRA_NATIVE_EXPR
+  SymRange applySummary(CallInst *CI);
+#endif
+  bool getSCEVExpr(const SCEV *S, SymExpr &Expr);
+  unsigned addSlot(Value *V, std::string Name, SymRange State);
+  unsigned getIndex(Value *V) const;
+
+  void getTransferOperands(unsigned Idx, SmallVectorImpl<Value*> &Ops) const;
+  void buildGraph();
+  void updateGraph(ArrayRef<unsigned> Dirty);
+  void buildSCCs();
+  void appendSCCs(ArrayRef<unsigned> Region);
+  bool wrapsLocally(unsigned Idx);
+  void computeMayWrap();
+  void markChanged(Value *V);
+  void update();
+
+#ifdef SRA_NATIVE_EXPR
+  bool loadCached(Function &F);
+  void storeCached();
+#endif
+
+  ArrayRef<unsigned> getOperands(unsigned Idx) const {
+    return makeArrayRef(Ops_).slice(OpsBegin_[Idx],
+                                    OpsEnd_[Idx] - OpsBegin_[Idx]);
+  }
+  ArrayRef<unsigned> getUsers(unsigned Idx) const {
+    return makeArrayRef(Users_).slice(UsersBegin_[Idx],
+                                      UsersEnd_[Idx] - UsersBegin_[Idx]);
+  }
+  ArrayRef<unsigned> getSCCMembers(unsigned SCC) const {
+    return makeArrayRef(SCCMembers_).slice(SCCBegin_[SCC],
+                                           SCCBegin_[SCC + 1] - SCCBegin_[SCC]);
+  }
+
+  Module   *Module_;
+  Function *Function_;
+  SymContext      *Ctx_;
+  Redefinition    *RDF_;
+  ScalarEvolution *SE_;
+
+#ifdef SRA_NATIVE_EXPR
+  std::unique_ptr<NativeContext> NativeCtx_;
+#endif
+  std::unique_ptr<SymbolicRangeContext> RangeCtx_;
+
+  const CalleeMap *Callees_;
 
-  std::map<Value*, std::string> Name_;
+  std::vector<Slot>          Slots_;
+  DenseMap<Value*, unsigned> Index_;
+
+  // Maps symbol names back to values, for materializing bounds.
   std::map<std::string, Value*> Value_;
-  std::map<Value*, SAGERange>   State_;
-  std::map<Value*, unsigned>    Changed_;
-  std::map<Value*, std::pair<bool, bool>> StableBounds_;
 
-  std::map< Instruction*, std::function<SAGERange()> > Fn_;
+  // Def-use graph between slots, as read by the transfer functions, in
+  // compressed row form: the operands of slot Idx are
+  // Ops_[OpsBegin_[Idx], OpsEnd_[Idx]), and likewise for its users. Updates
+  // append the rows they change, leaving the old ones behind until most of
+  // the entries are stale and the graph is rebuilt.
+  std::vector<unsigned> OpsBegin_,   OpsEnd_,   Ops_;
+  std::vector<unsigned> UsersBegin_, UsersEnd_, Users_;
+  unsigned              NumEdges_;
+
+  // Strongly connected components of the def-use graph, in topological
+  // order, so that operands are solved before their users. Updates append
+  // the components of the slots they reset; the components those slots left
+  // are marked solved, and never visited again.
+  std::vector<unsigned> SCCBegin_, SCCMembers_, SCCOf_;
+  BitVector             CyclicSCCs_;
 
-  std::map<Instruction*, unsigned>             Mapping_;
-  std::set<std::pair<unsigned, Instruction*> > Worklist_;
-  std::set<Instruction*>                       Evaled_;
+  // Scratch space for Tarjan's algorithm, which only touches the slots it is
+  // run on. Slots outside of the current run are numbered ~0u.
+  std::vector<unsigned> SCCNum_, SCCLow_;
+  BitVector             SCCOnStack_;
+
+  // Components whose members hold their final state. With -sra-lazy, a
+  // component is only solved once a query reaches it.
+  BitVector SolvedSCCs_;
+
+  SlotWorklist Worklist_;
+  BitVector    Evaled_;
+
+  // Slots whose transfer function changed since the last update.
+  std::vector<unsigned> Dirty_;
+
+  // Slots that may wrap, computed on the first query after each update.
+  BitVector MayWrap_;
+
+#ifdef SRA_NATIVE_EXPR
+  // Cache entry to be written once the function is solved, if any.
+  std::string CacheKey_;
+
+  // Values emitted by getRangeValuesFor at a single insertion point, which is
+  // the instruction before which they were inserted, or the block itself when
+  // inserting at its end.
+  void seedMaterialized(const NativeNode *N, Type *Ty, BasicBlock *BB,
+                        BasicBlock::iterator Pt, DominatorTree *DT,
+                        SmallPtrSetImpl<const NativeNode*> &Visited) const;
+  mutable WeakVH           MaterializedAt_;
+  mutable NativeValueCache Materialized_;
+
+  // Instructions of the function that compute each compound expression, as
+  // found among the solved slots. The index is built once, and again only
+  // when more components have been solved since; SeedsSolved_ holds their
+  // number at that point, or ~0u when the index is out of date.
+  void indexSeeds() const;
+  mutable DenseMap<const NativeNode*, SmallVector<WeakVH, 2>> Seeds_;
+  mutable unsigned SeedsSolved_;
+#endif
 };
 
 #endif
@@ -1,4 +1,5 @@
-#include "SymbolicRangeAnalysis.h"
+#include "SymbolicRangeAnalysisDriver.h"
+#include "SymbolicRangeMetadata.h"
 
 #include "llvm/Pass.h"
 #include "llvm/IR/Module.h"
@@ -21,27 +22,24 @@ static RegisterPass<SymbolicRangeAnalysisAnnotator>
 char SymbolicRangeAnalysisAnnotator::ID = 0;
 
 void SymbolicRangeAnalysisAnnotator::getAnalysisUsage(AnalysisUsage &AU) const {
-  AU.addRequired<SymbolicRangeAnalysis>();
+  AU.addRequired<SymbolicRangeAnalysisDriver>();
   AU.setPreservesAll();
 }
 
 bool SymbolicRangeAnalysisAnnotator::runOnModule(Module& M) {
+  auto &Driver = getAnalysis<SymbolicRangeAnalysisDriver>();
   for (auto &F : M) {
     if (F.isIntrinsic() || F.isDeclaration())
       continue;
 
-    auto &SRA = getAnalysis<SymbolicRangeAnalysis>(F);
+    auto &SRA = *Driver.getAnalysisFor(&F);
 
-    LLVMContext& C = M.getContext();
-    std::string Range;
-    raw_string_ostream Stream(Range);
+    SymbolicRangeMetadata Encoder(M.getContext());
     for (auto &BB : F)
       for (auto &I : BB)
-        if (I.getType()->isIntegerTy()) {
-          Stream << SRA.getStateOrInf(&I);
-          I.setMetadata("sra", MDNode::get(C, MDString::get(C, Stream.str())));
-          Stream.str().clear();
-        }
+        if (I.getType()->isIntegerTy())
+          I.setMetadata(SymbolicRangeMetadata::getKindName(),
+                        Encoder.encode(SRA.getStateOrInf(&I)));
   }
 
   return false;
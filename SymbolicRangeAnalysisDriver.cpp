@@ -0,0 +1,152 @@
+//===------------------- SymbolicRangeAnalysisDriver.cpp ------------------===//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "sra-driver"
+
+#include "SymbolicRangeAnalysisDriver.h"
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using namespace llvm;
+
+static RegisterPass<SymbolicRangeAnalysisDriver>
+  X("sra-driver", "Symbolic range analysis (module-level driver)");
+char SymbolicRangeAnalysisDriver::ID = 0;
+
+static cl::opt<unsigned>
+    NumThreads("sra-threads", cl::init(0), cl::Hidden,
+        cl::desc("Number of threads solving functions in parallel, or 0 for"
+            " one per hardware thread"));
+
+static cl::opt<bool>
+    Interprocedural("sra-interprocedural", cl::init(false), cl::Hidden,
+        cl::desc("Propagate ranges through calls using function summaries"
+            " (native backend only)"));
+
+void SymbolicRangeAnalysisDriver::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<Redefinition>();
+  AU.addRequired<ScalarEvolution>();
+  AU.addRequired<CallGraphWrapperPass>();
+#ifndef SRA_NATIVE_EXPR
+  AU.addRequired<SAGEInterface>();
+#endif
+  AU.setPreservesAll();
+}
+
+bool SymbolicRangeAnalysisDriver::runOnModule(Module& M) {
+  releaseMemory();
+
+#ifdef SRA_NATIVE_EXPR
+  // Every analysis creates its own context.
+  SymContext *Ctx = nullptr;
+  unsigned Threads = NumThreads ? NumThreads
+                                : std::thread::hardware_concurrency();
+  bool IsInterprocedural = Interprocedural;
+#else
+  // SAGE evaluates expressions through the Python interpreter, which may
+  // only be entered from one thread.
+  SymContext *Ctx = &getAnalysis<SAGEInterface>();
+  unsigned Threads = 1;
+  bool IsInterprocedural = false;
+#endif
+
+  // Redefinition modifies the IR, so it cannot run concurrently.
+  for (auto &F : M) {
+    if (F.isIntrinsic() || F.isDeclaration())
+      continue;
+
+    auto SRA = new SymbolicRangeAnalysis();
+    if (IsInterprocedural)
+      SRA->setCallees(&Summarized_);
+    auto &SE = getAnalysis<ScalarEvolution>(F);
+    SRA->prepare(F, &getAnalysis<Redefinition>(F), Ctx, &SE);
+    Analyses_.emplace_back(SRA);
+    Index_[&F] = SRA;
+  }
+
+  // Summaries are instantiated while callers are solved, so callees are
+  // always solved eagerly.
+  if (IsInterprocedural)
+    solveBottomUp();
+  else if (!Analyses_.empty() && !Analyses_.front()->isDemandDriven())
+    solveAll(std::max(Threads, 1u));
+
+  DEBUG(print(dbgs(), &M));
+
+  return false;
+}
+
+// Threads claim functions one at a time from a shared counter, so that a
+// thread which finishes early picks up the remaining work. Functions are
+// claimed largest first, to keep a single large function from serializing
+// the end of the run.
+void SymbolicRangeAnalysisDriver::solveAll(unsigned NumThreads) {
+  std::vector<SymbolicRangeAnalysis*> Order;
+  for (auto &SRA : Analyses_)
+    Order.push_back(SRA.get());
+  std::stable_sort(Order.begin(), Order.end(),
+                   [](SymbolicRangeAnalysis *LHS, SymbolicRangeAnalysis *RHS) {
+                     return LHS->getNumSlots() > RHS->getNumSlots();
+                   });
+
+  std::atomic<unsigned> Next(0);
+  auto Worker = [&Order, &Next]() {
+    for (unsigned I = Next++; I < Order.size(); I = Next++)
+      Order[I]->solve();
+  };
+
+  NumThreads = std::min<unsigned>(NumThreads, Order.size());
+  DEBUG(dbgs() << "SRA-DRIVER: solving " << Order.size() << " functions on "
+      << NumThreads << " threads\n");
+
+  std::vector<std::thread> Pool;
+  for (unsigned T = 1; T < NumThreads; ++T)
+    Pool.emplace_back(Worker);
+  Worker();
+  for (auto &Thread : Pool)
+    Thread.join();
+}
+
+// Visits the call graph SCCs callees first. A function's summary is only made
+// available once its whole SCC is solved, so calls within an SCC, and thus
+// recursive calls, are left unsummarized and no fixpoint over summaries is
+// needed.
+void SymbolicRangeAnalysisDriver::solveBottomUp() {
+  CallGraph &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+  for (auto I = scc_begin(&CG); !I.isAtEnd(); ++I) {
+    SmallVector<Function*, 4> Solved;
+    for (CallGraphNode *N : *I)
+      if (auto SRA = getAnalysisFor(N->getFunction())) {
+        SRA->solve();
+        Solved.push_back(N->getFunction());
+      }
+
+    for (auto F : Solved)
+      Summarized_[F] = Index_[F];
+  }
+}
+
+void SymbolicRangeAnalysisDriver::releaseMemory() {
+  Summarized_.clear();
+  Index_.clear();
+  Analyses_.clear();
+}
+
+SymbolicRangeAnalysis *
+    SymbolicRangeAnalysisDriver::getAnalysisFor(Function *F) const {
+  auto It = Index_.find(F);
+  return It == Index_.end() ? nullptr : It->second;
+}
+
+void SymbolicRangeAnalysisDriver::print(raw_ostream &OS,
+                                        const Module*) const {
+  for (auto &SRA : Analyses_)
+    SRA->print(OS, nullptr);
+}
@@ -0,0 +1,45 @@
+#ifndef _SYMBOLICRANGEANALYSISDRIVER_H_
+#define _SYMBOLICRANGEANALYSISDRIVER_H_
+
+#include "SymbolicRangeAnalysis.h"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+#include <vector>
+
+using namespace llvm;
+
+// Runs the symbolic range analysis over every function of a module. The
+// e-SSA form and slot tables are built sequentially, then functions are
+// solved on a pool of threads, largest first. In interprocedural mode,
+// functions are instead solved bottom-up over the call graph, so that calls
+// can use the summaries of their callees.
+class SymbolicRangeAnalysisDriver : public ModulePass {
+public:
+  static char ID;
+  SymbolicRangeAnalysisDriver() : ModulePass(ID) { }
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const;
+  virtual bool runOnModule(Module&);
+  virtual void releaseMemory();
+  virtual void print(raw_ostream &OS, const Module*) const;
+
+  // Returns the analysis of F, or null if F has no body.
+  SymbolicRangeAnalysis *getAnalysisFor(Function *F) const;
+
+private:
+  void solveAll(unsigned NumThreads);
+  void solveBottomUp();
+
+  std::vector< std::unique_ptr<SymbolicRangeAnalysis> > Analyses_;
+  DenseMap<Function*, SymbolicRangeAnalysis*>           Index_;
+
+  // Functions whose summaries are available to their callers.
+  SymbolicRangeAnalysis::CalleeMap Summarized_;
+};
+
+#endif
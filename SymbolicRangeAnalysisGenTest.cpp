@@ -3,6 +3,7 @@
 #define DEBUG_TYPE "sra-gen-test"
 
 #include "llvm/Pass.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/CommandLine.h"
@@ -24,12 +25,14 @@ static RegisterPass<SymbolicRangeAnalysisGenTest>
 char SymbolicRangeAnalysisGenTest::ID = 0;
 
 void SymbolicRangeAnalysisGenTest::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<DominatorTreeWrapperPass>();
   AU.addRequired<SymbolicRangeAnalysis>();
   AU.setPreservesAll();
 }
 
 bool SymbolicRangeAnalysisGenTest::runOnFunction(Function& F) {
   auto &SRA = getAnalysis<SymbolicRangeAnalysis>();
+  auto &DT  = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
 
   dbgs() << "SRA-GEN: runOnFunction: " << F.getName() << "\n";
 
@@ -44,7 +47,7 @@ bool SymbolicRangeAnalysisGenTest::runOnFunction(Function& F) {
     for (auto I : Ins) {
       DEBUG(dbgs() << "Generating ranges: " << SRA.getStateOrInf(I)
                    << " for instruction " << *I << "\n");
-      SRA.getRangeValuesFor(I, IRB);
+      SRA.getRangeValuesFor(I, IRB, &DT);
     }
   }
 
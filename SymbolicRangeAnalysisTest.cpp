@@ -27,11 +27,11 @@ public:
   std::vector<Argument*> getArgs(Function *F);
 
   template <typename T>
-  std::vector<SAGEExpr> getExprs(
-      SymbolicRangeAnalysis *SRA, SAGEInterface *SI, std::vector<T> Values) {
-    std::vector<SAGEExpr> Ret;
+  std::vector<SymExpr> getExprs(
+      SymbolicRangeAnalysis *SRA, std::vector<T> Values) {
+    std::vector<SymExpr> Ret;
     for (auto V : Values) {
-      Ret.push_back(SAGEExpr(*SI, SRA->getName(V)));
+      Ret.push_back(SymExpr(SRA->getContext(), SRA->getName(V)));
     }
     return Ret;
   }
@@ -45,9 +45,19 @@ public:
 
   void createUse(IRBuilder<> IRB, Value *V, BasicBlock *BB);
 
-  void assertRangeEq(SymbolicRangeAnalysis *SRA, Value *V, SAGERange Second);
+  void assertRangeEq(SymbolicRangeAnalysis *SRA, Value *V, SymRange Second);
+  void assertMayWrap(SymbolicRangeAnalysis *SRA, Value *V, bool Expected);
+  void assertMaterializable(SymbolicRangeAnalysis *SRA, SymExpr E,
+                            bool Expected);
 
   void testSimpleIf();
+  void testSimpleLoop();
+  void testIntegerOps();
+  void testWraparound();
+  void testMaterializable();
+  void testLoopBounds();
+  void testSeedReuse();
+  void testUpdate();
 
 
 private:
@@ -62,7 +72,9 @@ char SymbolicRangeAnalysisTest::ID = 0;
 void SymbolicRangeAnalysisTest::getAnalysisUsage(AnalysisUsage &AU) const {
   AU.addRequired<Redefinition>();
   AU.addRequired<SymbolicRangeAnalysis>();
+#ifndef SRA_NATIVE_EXPR
   AU.addRequired<SAGEInterface>();
+#endif
 }
 
 bool SymbolicRangeAnalysisTest::runOnModule(Module& M) {
@@ -70,6 +82,13 @@ bool SymbolicRangeAnalysisTest::runOnModule(Module& M) {
   Context_ = &M.getContext();
 
   testSimpleIf();
+  testSimpleLoop();
+  testIntegerOps();
+  testWraparound();
+  testMaterializable();
+  testLoopBounds();
+  testSeedReuse();
+  testUpdate();
 
   return false;
 }
@@ -145,8 +164,8 @@ void SymbolicRangeAnalysisTest::createUse(
 }
 
 void SymbolicRangeAnalysisTest::assertRangeEq(
-    SymbolicRangeAnalysis *SRA, Value *V, SAGERange Second) {
-  SAGERange First = SRA->getState(V);
+    SymbolicRangeAnalysis *SRA, Value *V, SymRange Second) {
+  SymRange First = SRA->getState(V);
   if (!First.getLower().isEQ(Second.getLower())) {
     errs() << "ERROR: assertRangeEq: unmatched lower bound for value " << *V
            << ":\nExpected " << Second.getLower() << ", got "
@@ -160,6 +179,23 @@ void SymbolicRangeAnalysisTest::assertRangeEq(
   DEBUG(dbgs() << "SRATest: range match: " << First << ", " << Second << "\n");
 }
 
+void SymbolicRangeAnalysisTest::assertMayWrap(
+    SymbolicRangeAnalysis *SRA, Value *V, bool Expected) {
+  if (SRA->mayWrap(V) != Expected) {
+    errs() << "ERROR: assertMayWrap: expected value " << *V
+           << (Expected ? " to wrap" : " not to wrap") << "\n";
+  }
+}
+
+void SymbolicRangeAnalysisTest::assertMaterializable(
+    SymbolicRangeAnalysis *SRA, SymExpr E, bool Expected) {
+  if (SRA->isMaterializable(E, Type::getInt32Ty(*Context_),
+                            Type::getInt64Ty(*Context_)) != Expected) {
+    errs() << "ERROR: assertMaterializable: expected bound " << E
+           << (Expected ? " to be" : " not to be") << " materializable\n";
+  }
+}
+
 void SymbolicRangeAnalysisTest::testSimpleIf() {
   /* void test_simple_if(int a, int b) {
    *   if (a < b) {
@@ -184,19 +220,339 @@ void SymbolicRangeAnalysisTest::testSimpleIf() {
   IRB.SetInsertPoint(If.End);
   IRB.CreateRetVoid();
 
-  auto &SI = getAnalysis<SAGEInterface>();
   auto &RDF = getAnalysis<Redefinition>(*F);
   auto &SRA = getAnalysis<SymbolicRangeAnalysis>(*F);
 
-  std::vector<SAGEExpr> Exprs = getExprs(&SRA, &SI, Args);
+  std::vector<SymExpr> Exprs = getExprs(&SRA, Args);
 
   assertRangeEq(
-      &SRA, RDF.getRedef(Args[0], If.Then), SAGERange(Exprs[0], Exprs[1] - 1));
+      &SRA, RDF.getRedef(Args[0], If.Then), SymRange(Exprs[0], Exprs[1] - 1));
   assertRangeEq(
-      &SRA, RDF.getRedef(Args[1], If.Then), SAGERange(Exprs[0] + 1, Exprs[1]));
+      &SRA, RDF.getRedef(Args[1], If.Then), SymRange(Exprs[0] + 1, Exprs[1]));
   assertRangeEq(
-      &SRA, RDF.getRedef(Args[0], If.Else), SAGERange(Exprs[1], Exprs[0]));
+      &SRA, RDF.getRedef(Args[0], If.Else), SymRange(Exprs[1], Exprs[0]));
   assertRangeEq(
-      &SRA, RDF.getRedef(Args[1], If.Else), SAGERange(Exprs[1], Exprs[0]));
+      &SRA, RDF.getRedef(Args[1], If.Else), SymRange(Exprs[1], Exprs[0]));
+}
+
+void SymbolicRangeAnalysisTest::testSimpleLoop() {
+  /* void test_simple_loop(int n) {
+   *   for (int i = 0; i < n; ++i) {
+   *     // 0 <= i < n
+   *     // Use "i".
+   *   }
+   * }
+   */
+  Function *F = createTestFunction("test_simple_loop", 1);
+  IRBuilder<> IRB = createIRB(F);
+
+  std::vector<Argument*> Args = getArgs(F);
+
+  BasicBlock *Entry = IRB.GetInsertBlock(),
+             *Cond  = createBB(F, "for.cond"),
+             *Body  = createBB(F, "for.body"),
+             *End   = createBB(F, "for.end");
+  IRB.CreateBr(Cond);
+
+  IRB.SetInsertPoint(Cond);
+  PHINode *I = IRB.CreatePHI(IRB.getInt32Ty(), 2, "i");
+  IRB.CreateCondBr(IRB.CreateICmpSLT(I, Args[0]), Body, End);
+
+  IRB.SetInsertPoint(Body);
+  Value *Inc = IRB.CreateNSWAdd(I, IRB.getInt32(1), "inc");
+  IRB.CreateBr(Cond);
+  createUse(IRB, I, Body);
+
+  I->addIncoming(IRB.getInt32(0), Entry);
+  I->addIncoming(Inc, Body);
+
+  IRB.SetInsertPoint(End);
+  IRB.CreateRetVoid();
+
+  auto &RDF = getAnalysis<Redefinition>(*F);
+  auto &SRA = getAnalysis<SymbolicRangeAnalysis>(*F);
+
+  std::vector<SymExpr> Exprs = getExprs(&SRA, Args);
+  SymExpr Zero(SRA.getContext(), (int64_t) 0);
+
+  // The induction variable is bounded by its trip count, max(0, n).
+  assertRangeEq(&SRA, I, SymRange(Zero, Zero.max(Exprs[0])));
+  assertRangeEq(
+      &SRA, RDF.getRedef(I, Body), SymRange(Zero, Exprs[0] - 1));
+}
+
+void SymbolicRangeAnalysisTest::testIntegerOps() {
+  /* void test_integer_ops(int a, int b) {
+   *   int m = a < b ? a : b;   // min(a, b)
+   *   int s = a << 2;          // 4 * a
+   *   int k = a & 255;         // [0, 255]
+   *   unsigned r = a % 8u;     // [0, 7]
+   * }
+   */
+  Function *F = createTestFunction("test_integer_ops", 2);
+  IRBuilder<> IRB = createIRB(F);
+
+  std::vector<Argument*> Args = getArgs(F);
+
+  Value *Min = IRB.CreateSelect(IRB.CreateICmpSLT(Args[0], Args[1]),
+                                Args[0], Args[1], "m");
+  Value *Shl = IRB.CreateShl(Args[0], 2, "s");
+  Value *And = IRB.CreateAnd(Args[0], 255, "k");
+  Value *Rem = IRB.CreateURem(Args[0], IRB.getInt32(8), "r");
+  IRB.CreateRetVoid();
+
+  auto &SRA = getAnalysis<SymbolicRangeAnalysis>(*F);
+
+  std::vector<SymExpr> Exprs = getExprs(&SRA, Args);
+  SymExpr Zero(SRA.getContext(), (int64_t) 0);
+
+  assertRangeEq(&SRA, Min, SymRange(Exprs[0].min(Exprs[1])));
+  assertRangeEq(&SRA, Shl, SymRange(Exprs[0] * 4));
+  assertRangeEq(&SRA, And, SymRange(Zero, Zero + 255));
+  assertRangeEq(&SRA, Rem, SymRange(Zero, Zero + 7));
 }
 
+void SymbolicRangeAnalysisTest::testWraparound() {
+  /* void test_wraparound(int a) {
+   *   char t = a & 127;        // [0, 127], fits
+   *   char u = a & 255;        // [0, 255], may wrap
+   *   int z = (unsigned char) t;
+   *   int s = u;               // wraps with u
+   *   int x = a + 1;           // may wrap
+   *   int y = a + 1;           // nsw
+   *   if ((unsigned) a < 10u) {
+   *     // 0 <= a < 10
+   *   } else {
+   *     // a may be negative
+   *   }
+   * }
+   */
+  Function *F = createTestFunction("test_wraparound", 1);
+  IRBuilder<> IRB = createIRB(F);
+
+  std::vector<Argument*> Args = getArgs(F);
+
+  Value *T = IRB.CreateTrunc(IRB.CreateAnd(Args[0], 127), IRB.getInt8Ty(), "t");
+  Value *U = IRB.CreateTrunc(IRB.CreateAnd(Args[0], 255), IRB.getInt8Ty(), "u");
+  Value *Z = IRB.CreateZExt(T, IRB.getInt32Ty(), "z");
+  Value *S = IRB.CreateSExt(U, IRB.getInt32Ty(), "s");
+  Value *X = IRB.CreateAdd(Args[0], IRB.getInt32(1), "x");
+  Value *Y = IRB.CreateNSWAdd(Args[0], IRB.getInt32(1), "y");
+  auto If =
+      createIfElseWithUses(
+          IRB, cast<ICmpInst>(IRB.CreateICmpULT(Args[0], IRB.getInt32(10))));
+  IRB.SetInsertPoint(If.End);
+  IRB.CreateRetVoid();
+
+  auto &RDF = getAnalysis<Redefinition>(*F);
+  auto &SRA = getAnalysis<SymbolicRangeAnalysis>(*F);
+
+  std::vector<SymExpr> Exprs = getExprs(&SRA, Args);
+
+  // Compares on t, z and y may be folded by their ranges, those on u, s and
+  // x may not.
+  assertMayWrap(&SRA, T, false);
+  assertMayWrap(&SRA, U, true);
+  assertMayWrap(&SRA, Z, false);
+  assertMayWrap(&SRA, S, true);
+  assertMayWrap(&SRA, X, true);
+  assertMayWrap(&SRA, Y, false);
+  assertRangeEq(&SRA, Y, SymRange(Exprs[0] + 1));
+  assertMayWrap(&SRA, RDF.getRedef(Args[0], If.Then), false);
+  assertMayWrap(&SRA, RDF.getRedef(Args[0], If.Else), true);
+}
+
+void SymbolicRangeAnalysisTest::testMaterializable() {
+  /* void test_materializable(int n) {
+   *   // Bounds of int values are checked against the limits of int, and
+   *   // emitted as long, in which n + 10 cannot overflow, but n * n * n can.
+   * }
+   */
+  Function *F = createTestFunction("test_materializable", 1);
+  IRBuilder<> IRB = createIRB(F);
+
+  std::vector<Argument*> Args = getArgs(F);
+  IRB.CreateRetVoid();
+
+  auto &SRA = getAnalysis<SymbolicRangeAnalysis>(*F);
+
+  std::vector<SymExpr> Exprs = getExprs(&SRA, Args);
+  SymContext &Ctx = SRA.getContext();
+  SymExpr IntMax(Ctx, (int64_t) INT32_MAX), UIntMax(Ctx, (int64_t) UINT32_MAX);
+
+  assertMaterializable(&SRA, Exprs[0] - 1, true);
+  assertMaterializable(&SRA, IntMax, true);
+  assertMaterializable(&SRA, IntMax + 1, false);
+  assertMaterializable(&SRA, UIntMax, false);
+  assertMaterializable(&SRA, Exprs[0].min(UIntMax - 1), false);
+  assertMaterializable(&SRA, SymExpr(Ctx, "UINT_MAX"), false);
+  assertMaterializable(&SRA, SRA.getRangeContext().InfRange.getUpper(), false);
+#ifdef SRA_NATIVE_EXPR
+  assertMaterializable(&SRA, Exprs[0] + 10, true);
+  assertMaterializable(&SRA, Exprs[0] * Exprs[0], true);
+  assertMaterializable(&SRA, Exprs[0] * Exprs[0] * Exprs[0], false);
+  assertMaterializable(&SRA, Exprs[0] * ((int64_t) 1 << 40), false);
+#endif
+}
+
+void SymbolicRangeAnalysisTest::testLoopBounds() {
+  /* void test_loop_bounds(int n) {
+   *   // The range of "v" is emitted here, as long.
+   *   for (int i = 0; i < n; ++i) {
+   *     int v = i + 10;
+   *     // Use "v".
+   *   }
+   * }
+   */
+  Function *F = createTestFunction("test_loop_bounds", 1);
+  IRBuilder<> IRB = createIRB(F);
+
+  std::vector<Argument*> Args = getArgs(F);
+
+  BasicBlock *Entry = IRB.GetInsertBlock(),
+             *Cond  = createBB(F, "for.cond"),
+             *Body  = createBB(F, "for.body"),
+             *End   = createBB(F, "for.end");
+  Instruction *Br = IRB.CreateBr(Cond);
+
+  IRB.SetInsertPoint(Cond);
+  PHINode *I = IRB.CreatePHI(IRB.getInt32Ty(), 2, "i");
+  IRB.CreateCondBr(IRB.CreateICmpSLT(I, Args[0]), Body, End);
+
+  IRB.SetInsertPoint(Body);
+  Value *V = IRB.CreateNSWAdd(I, IRB.getInt32(10), "v");
+  Value *Inc = IRB.CreateNSWAdd(I, IRB.getInt32(1), "inc");
+  IRB.CreateBr(Cond);
+  createUse(IRB, V, Body);
+
+  I->addIncoming(IRB.getInt32(0), Entry);
+  I->addIncoming(Inc, Body);
+
+  IRB.SetInsertPoint(End);
+  IRB.CreateRetVoid();
+
+  auto &SRA = getAnalysis<SymbolicRangeAnalysis>(*F);
+
+  // With n close to INT_MAX, the upper bound of "v" overflows int, but not
+  // long, where the check v < bound can then be hoisted.
+  SymRange Range = SRA.getState(V);
+  assertMaterializable(&SRA, Range.getLower(), true);
+  assertMaterializable(&SRA, Range.getUpper(), true);
+
+  IRB.SetInsertPoint(Br);
+  auto Bounds = SRA.getRangeValuesFor(V, IRB, nullptr, IRB.getInt64Ty());
+  if (Bounds.first->getType() != IRB.getInt64Ty() ||
+      Bounds.second->getType() != IRB.getInt64Ty())
+    errs() << "ERROR: testLoopBounds: bounds of " << *V
+           << " are not emitted as i64\n";
+}
+
+void SymbolicRangeAnalysisTest::testSeedReuse() {
+  /* void test_seed_reuse(int y) {
+   *   long a = (unsigned) y + 1l;  // y + 1, unless y is negative
+   *   long b = y + 1l;             // y + 1
+   *   // Bounds of "b" are emitted here.
+   * }
+   */
+  Function *F = createTestFunction("test_seed_reuse", 1);
+  IRBuilder<> IRB = createIRB(F);
+
+  std::vector<Argument*> Args = getArgs(F);
+
+  Value *A = IRB.CreateNSWAdd(IRB.CreateZExt(Args[0], IRB.getInt64Ty()),
+                              IRB.getInt64(1), "a");
+  Value *B = IRB.CreateNSWAdd(IRB.CreateSExt(Args[0], IRB.getInt64Ty()),
+                              IRB.getInt64(1), "b");
+  Instruction *Ret = IRB.CreateRetVoid();
+
+  auto &SRA = getAnalysis<SymbolicRangeAnalysis>(*F);
+
+  // Both have the range [y + 1, y + 1], but "a" may wrap, so it must not
+  // stand for the bounds of "b".
+  IRB.SetInsertPoint(Ret);
+  auto Bounds = SRA.getRangeValuesFor(B, IRB);
+  if (Bounds.first == A || Bounds.second == A)
+    errs() << "ERROR: testSeedReuse: bound of " << *B << " reuses " << *A
+           << "\n";
+#ifdef SRA_NATIVE_EXPR
+  if (Bounds.first != B || Bounds.second != B)
+    errs() << "ERROR: testSeedReuse: bound of " << *B << " is not reused\n";
+#endif
+}
+
+void SymbolicRangeAnalysisTest::testUpdate() {
+  /* void test_update(int a, int n) {
+   *   int x = a + 1;
+   *   int y = x + 1;
+   *   for (int i = 0; i < n; ++i) {
+   *     // Use "i".
+   *   }
+   * }
+   *
+   * The function is then edited, and the analysis notified of each edit.
+   */
+  Function *F = createTestFunction("test_update", 2);
+  IRBuilder<> IRB = createIRB(F);
+
+  std::vector<Argument*> Args = getArgs(F);
+
+  Instruction *X =
+      cast<Instruction>(IRB.CreateNSWAdd(Args[0], IRB.getInt32(1), "x"));
+  Instruction *Y =
+      cast<Instruction>(IRB.CreateNSWAdd(X, IRB.getInt32(1), "y"));
+
+  BasicBlock *Entry = IRB.GetInsertBlock(),
+             *Cond  = createBB(F, "for.cond"),
+             *Body  = createBB(F, "for.body"),
+             *End   = createBB(F, "for.end");
+  IRB.CreateBr(Cond);
+
+  IRB.SetInsertPoint(Cond);
+  PHINode *I = IRB.CreatePHI(IRB.getInt32Ty(), 2, "i");
+  IRB.CreateCondBr(IRB.CreateICmpSLT(I, Args[1]), Body, End);
+
+  IRB.SetInsertPoint(Body);
+  Value *Inc = IRB.CreateNSWAdd(I, IRB.getInt32(1), "inc");
+  IRB.CreateBr(Cond);
+  createUse(IRB, I, Body);
+
+  I->addIncoming(IRB.getInt32(0), Entry);
+  I->addIncoming(Inc, Body);
+
+  IRB.SetInsertPoint(End);
+  IRB.CreateRetVoid();
+
+  auto &RDF = getAnalysis<Redefinition>(*F);
+  auto &SRA = getAnalysis<SymbolicRangeAnalysis>(*F);
+
+  std::vector<SymExpr> Exprs = getExprs(&SRA, Args);
+  SymExpr Zero(SRA.getContext(), (int64_t) 0);
+
+  assertRangeEq(&SRA, Y, SymRange(Exprs[0] + 2));
+
+  // Changed operands reach the users.
+  X->setOperand(1, IRB.getInt32(5));
+  SRA.notifyChanged(X);
+  assertRangeEq(&SRA, Y, SymRange(Exprs[0] + 6));
+
+  // New instructions get ranges.
+  IRB.SetInsertPoint(Entry->getTerminator());
+  Instruction *Z = cast<Instruction>(IRB.CreateNSWAdd(Y, Args[0], "z"));
+  SRA.notifyChanged(Z);
+  assertRangeEq(&SRA, Z, SymRange(Exprs[0] * 2 + 6));
+
+  // Erased instructions are forgotten.
+  SRA.forget(Z);
+  Z->eraseFromParent();
+  Y->setOperand(0, Args[0]);
+  SRA.notifyChanged(Y);
+  SRA.forget(X);
+  X->eraseFromParent();
+  assertRangeEq(&SRA, Y, SymRange(Exprs[0] + 1));
+
+  // Loops are solved again.
+  I->setIncomingValue(0, IRB.getInt32(1));
+  SRA.notifyChanged(I);
+  assertRangeEq(
+      &SRA, RDF.getRedef(I, Body), SymRange(Zero + 1, Exprs[1] - 1));
+}
@@ -1,4 +1,5 @@
 #include "SymbolicRangeAnalysis.h"
+#include "SymbolicRangeMetadata.h"
 
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
@@ -26,26 +27,23 @@ void SymbolicRangeAnalysisVerifier::getAnalysisUsage(AnalysisUsage &AU) const {
 bool SymbolicRangeAnalysisVerifier::runOnFunction(Function& F) {
   auto &SRA = getAnalysis<SymbolicRangeAnalysis>();
   bool HasError = false;
-  std::string Range;
-  raw_string_ostream Stream(Range);
 
+  SymbolicRangeMetadata Reader(F.getContext());
   for (auto &BB : F) {
     for (auto &I : BB) {
-      if (MDNode *MD = I.getMetadata("sra")) {
-        Stream << SRA.getStateOrInf(&I);
-        StringRef Expected = cast<MDString>(*MD->getOperand(0)).getString();
-        if (Stream.str() != Expected) {
+      if (MDNode *MD = I.getMetadata(SymbolicRangeMetadata::getKindName())) {
+        auto Range = SRA.getStateOrInf(&I);
+        if (!Reader.matches(MD, Range)) {
           if (!HasError) {
             errs() << "FAILED: " << F.getName() << "\n";
             HasError = true;
           }
 
           errs() << "ERROR: Ranges differ on instruction " << I << "\n";
-          errs() << "       Expected " << Expected << " got " << Stream.str()
-              << "\n";
+          errs() << "       Expected ";
+          SymbolicRangeMetadata::print(errs(), MD);
+          errs() << " got " << Range << "\n";
         }
-
-        Stream.str().clear();
       }
     }
   }
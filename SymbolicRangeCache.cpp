@@ -0,0 +1,247 @@
+//===----------------------- SymbolicRangeCache.cpp -----------------------===//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "sra-cache"
+
+#include "SymbolicRangeCache.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+// Bumped whenever the layout of an entry changes.
+static const char CacheMagic[] = "SRAC0001";
+
+namespace {
+
+class EntryWriter {
+public:
+  EntryWriter(raw_ostream &OS) : OS_(OS) { }
+
+  void writeInt(uint64_t Int, unsigned Bytes) {
+    for (unsigned Idx = 0; Idx < Bytes; ++Idx)
+      OS_ << (char) ((Int >> (8 * Idx)) & 0xff);
+  }
+
+  unsigned getNumNodes() const { return Index_.size(); }
+
+  unsigned writeNode(const NativeNode *N) {
+    auto It = Index_.find(N);
+    if (It != Index_.end())
+      return It->second;
+
+    SmallVector<unsigned, 4> Ops;
+    for (auto Op : N->getOps())
+      Ops.push_back(writeNode(Op));
+
+    writeInt(N->getKind(), 1);
+    writeInt(N->getInt(), 8);
+    writeInt(N->getName().size(), 4);
+    OS_ << N->getName();
+    writeInt(Ops.size(), 4);
+    for (unsigned Idx = 0; Idx < Ops.size(); ++Idx) {
+      writeInt(Ops[Idx], 4);
+      if (N->getKind() == NativeNode::NK_Add)
+        writeInt(N->getCoeffs()[Idx], 8);
+    }
+
+    unsigned Idx = Index_.size();
+    Index_[N] = Idx;
+    return Idx;
+  }
+
+private:
+  raw_ostream                           &OS_;
+  DenseMap<const NativeNode*, unsigned>  Index_;
+};
+
+class EntryReader {
+public:
+  EntryReader(StringRef Buffer, NativeContext &Ctx)
+      : Buffer_(Buffer), Ctx_(Ctx), Failed_(false) { }
+
+  bool failed() const { return Failed_; }
+
+  uint64_t readInt(unsigned Bytes) {
+    if (Buffer_.size() < Bytes) {
+      Failed_ = true;
+      return 0;
+    }
+    uint64_t Int = 0;
+    for (unsigned Idx = 0; Idx < Bytes; ++Idx)
+      Int |= (uint64_t) (unsigned char) Buffer_[Idx] << (8 * Idx);
+    Buffer_ = Buffer_.drop_front(Bytes);
+    return Int;
+  }
+
+  StringRef readString(unsigned Size) {
+    if (Buffer_.size() < Size) {
+      Failed_ = true;
+      return StringRef();
+    }
+    StringRef Str = Buffer_.substr(0, Size);
+    Buffer_ = Buffer_.drop_front(Size);
+    return Str;
+  }
+
+  const NativeNode *readNodeRef() {
+    uint64_t Idx = readInt(4);
+    if (Idx >= Nodes_.size()) {
+      Failed_ = true;
+      return Ctx_.getUndef();
+    }
+    return Nodes_[Idx];
+  }
+
+  // Nodes are rebuilt through the context's operations rather than copied,
+  // since the order of commutative operands depends on creation order.
+  void readNode() {
+    unsigned Kind = readInt(1);
+    int64_t Int = readInt(8);
+    StringRef Name = readString(readInt(4));
+    unsigned NumOps = readInt(4);
+
+    const NativeNode *N = nullptr;
+    switch (Kind) {
+      case NativeNode::NK_Int:      N = Ctx_.getInt(Int);    break;
+      case NativeNode::NK_Sym:      N = Ctx_.getSym(Name);   break;
+      case NativeNode::NK_MinusInf: N = Ctx_.getMinusInf();  break;
+      case NativeNode::NK_PlusInf:  N = Ctx_.getPlusInf();   break;
+      case NativeNode::NK_Undef:    N = Ctx_.getUndef();     break;
+      case NativeNode::NK_Add:
+        N = Ctx_.getInt(Int);
+        for (unsigned Idx = 0; Idx < NumOps; ++Idx) {
+          const NativeNode *Op = readNodeRef();
+          int64_t Coeff = readInt(8);
+          N = Ctx_.getAdd(N, Ctx_.getMul(Op, Ctx_.getInt(Coeff)));
+        }
+        break;
+      case NativeNode::NK_Mul:
+      case NativeNode::NK_Div:
+      case NativeNode::NK_Min:
+      case NativeNode::NK_Max:
+        for (unsigned Idx = 0; Idx < NumOps; ++Idx) {
+          const NativeNode *Op = readNodeRef();
+          if (!N)
+            N = Op;
+          else if (Kind == NativeNode::NK_Mul)
+            N = Ctx_.getMul(N, Op);
+          else if (Kind == NativeNode::NK_Div)
+            N = Ctx_.getDiv(N, Op);
+          else if (Kind == NativeNode::NK_Min)
+            N = Ctx_.getMin(N, Op);
+          else
+            N = Ctx_.getMax(N, Op);
+        }
+        break;
+      default:
+        Failed_ = true;
+        break;
+    }
+
+    if (!N) {
+      Failed_ = true;
+      N = Ctx_.getUndef();
+    }
+    Nodes_.push_back(N);
+  }
+
+private:
+  StringRef                      Buffer_;
+  NativeContext                 &Ctx_;
+  std::vector<const NativeNode*> Nodes_;
+  bool                           Failed_;
+};
+
+} // end anonymous namespace
+
+std::string SymbolicRangeCache::getKey(const Function &F, StringRef Options) {
+  std::string IR;
+  raw_string_ostream Stream(IR);
+  F.print(Stream);
+
+  MD5 Hash;
+  Hash.update(CacheMagic);
+  Hash.update(Options);
+  Hash.update(Stream.str());
+
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Key;
+  MD5::stringifyResult(Result, Key);
+  return std::string(Key.str());
+}
+
+std::string SymbolicRangeCache::getPath(StringRef Key) const {
+  SmallString<128> Path(Dir_);
+  sys::path::append(Path, Key + ".sra");
+  return std::string(Path.str());
+}
+
+bool SymbolicRangeCache::load(StringRef Key, NativeContext &Ctx,
+                              std::vector<NativeRange> &Ranges) const {
+  auto Buffer = MemoryBuffer::getFile(getPath(Key));
+  if (!Buffer)
+    return false;
+
+  EntryReader Reader((*Buffer)->getBuffer(), Ctx);
+  if (Reader.readString(sizeof(CacheMagic) - 1) != CacheMagic)
+    return false;
+
+  unsigned NumNodes = Reader.readInt(4);
+  for (unsigned Idx = 0; Idx < NumNodes && !Reader.failed(); ++Idx)
+    Reader.readNode();
+
+  unsigned NumRanges = Reader.readInt(4);
+  for (unsigned Idx = 0; Idx < NumRanges && !Reader.failed(); ++Idx) {
+    const NativeNode *Lower = Reader.readNodeRef(),
+                     *Upper = Reader.readNodeRef();
+    Ranges.push_back(NativeRange(NativeExpr(Ctx, Lower),
+                                 NativeExpr(Ctx, Upper)));
+  }
+
+  DEBUG(dbgs() << "SRA-CACHE: " << (Reader.failed() ? "corrupt" : "hit")
+      << ": " << Key << "\n");
+  return !Reader.failed();
+}
+
+void SymbolicRangeCache::store(StringRef Key,
+                               ArrayRef<NativeRange> Ranges) const {
+  if (sys::fs::create_directories(Dir_))
+    return;
+
+  // Nodes are written ahead of the ranges that refer to them.
+  std::string Nodes, Refs;
+  raw_string_ostream NodesStream(Nodes), RefsStream(Refs);
+  EntryWriter NodesWriter(NodesStream), RefsWriter(RefsStream);
+  for (auto &Range : Ranges) {
+    RefsWriter.writeInt(NodesWriter.writeNode(Range.getNode()->Lower), 4);
+    RefsWriter.writeInt(NodesWriter.writeNode(Range.getNode()->Upper), 4);
+  }
+
+  int FD;
+  SmallString<128> TempPath;
+  if (sys::fs::createUniqueFile(getPath(Key) + ".tmp%%%%%%", FD, TempPath))
+    return;
+
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    EntryWriter Writer(OS);
+    OS << CacheMagic;
+    Writer.writeInt(NodesWriter.getNumNodes(), 4);
+    OS << NodesStream.str();
+    Writer.writeInt(Ranges.size(), 4);
+    OS << RefsStream.str();
+  }
+
+  if (sys::fs::rename(TempPath, getPath(Key)))
+    sys::fs::remove(TempPath);
+  DEBUG(dbgs() << "SRA-CACHE: stored: " << Key << "\n");
+}
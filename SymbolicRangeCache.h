@@ -0,0 +1,44 @@
+#ifndef _SYMBOLICRANGECACHE_H_
+#define _SYMBOLICRANGECACHE_H_
+
+#include "NativeExpr.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+// On-disk cache of converged ranges, one file per analysed function. Entries
+// are content-addressed: the key is an MD5 hash of the printed function and
+// of the analysis options that affect its results, so an entry is reused
+// exactly when the same function is analysed the same way again.
+//
+// Ranges are stored as a table of expression nodes, operands first, followed
+// by the (lower, upper) node indices of each range. Nodes shared between
+// ranges are stored once.
+class SymbolicRangeCache {
+public:
+  explicit SymbolicRangeCache(StringRef Dir) : Dir_(Dir) { }
+
+  static std::string getKey(const Function &F, StringRef Options);
+
+  // Appends the ranges stored under Key to Ranges, built in Ctx. Returns
+  // false if there is no such entry, or if it cannot be read.
+  bool load(StringRef Key, NativeContext &Ctx,
+            std::vector<NativeRange> &Ranges) const;
+
+  // Stores Ranges under Key. Entries are written to a temporary file and
+  // renamed into place, so concurrent writers never expose partial entries.
+  void store(StringRef Key, ArrayRef<NativeRange> Ranges) const;
+
+private:
+  std::string getPath(StringRef Key) const;
+
+  std::string Dir_;
+};
+
+#endif
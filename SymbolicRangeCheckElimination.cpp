@@ -0,0 +1,210 @@
+//===------------------ SymbolicRangeCheckElimination.cpp -----------------===//
+//===----------------------------------------------------------------------===//
+
+#include "SymbolicRangeAnalysis.h"
+
+#define DEBUG_TYPE "sra-check-elim"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#include <limits>
+
+using namespace llvm;
+
+STATISTIC(NumComparesFolded,   "Number of comparisons decided by ranges");
+STATISTIC(NumBranchesFolded,   "Number of conditional branches removed");
+STATISTIC(NumOverflowsRemoved, "Number of overflow checks removed");
+
+// Folds the comparisons and overflow checks whose outcome is decided by the
+// symbolic ranges of their operands. Branches on folded comparisons become
+// unconditional; the blocks they no longer reach are left to SimplifyCFG.
+class SymbolicRangeCheckElimination : public FunctionPass {
+public:
+  static char ID;
+  SymbolicRangeCheckElimination() : FunctionPass(ID) { }
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const;
+  virtual bool runOnFunction(Function&);
+
+private:
+  bool isKnown(CmpInst::Predicate Pred, const SymRange &LHS,
+               const SymRange &RHS);
+  bool foldCompare(ICmpInst *ICI);
+  bool foldOverflowCheck(IntrinsicInst *II);
+
+  SymbolicRangeAnalysis *SRA_;
+};
+
+static RegisterPass<SymbolicRangeCheckElimination>
+  X("sra-check-elim", "Symbolic range analysis check elimination");
+char SymbolicRangeCheckElimination::ID = 0;
+
+void SymbolicRangeCheckElimination::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.addRequired<SymbolicRangeAnalysis>();
+}
+
+// Returns true if LHS Pred RHS holds for every pair of values in the ranges.
+bool SymbolicRangeCheckElimination::isKnown(CmpInst::Predicate Pred,
+                                            const SymRange &LHS,
+                                            const SymRange &RHS) {
+  // Unsigned comparisons agree with signed ones on non-negative values.
+  if (ICmpInst::isUnsigned(Pred)) {
+    SymExpr Zero(SRA_->getContext(), (int64_t) 0);
+    if (!LHS.getLower().isGE(Zero) || !RHS.getLower().isGE(Zero))
+      return false;
+    Pred = ICmpInst::getSignedPredicate(Pred);
+  }
+
+  switch (Pred) {
+    case CmpInst::ICMP_SLT:
+      return LHS.getUpper().isLT(RHS.getLower());
+    case CmpInst::ICMP_SLE:
+      return LHS.getUpper().isLE(RHS.getLower());
+    case CmpInst::ICMP_SGT:
+      return LHS.getLower().isGT(RHS.getUpper());
+    case CmpInst::ICMP_SGE:
+      return LHS.getLower().isGE(RHS.getUpper());
+    case CmpInst::ICMP_EQ:
+      return LHS.getLower().isEQ(LHS.getUpper()) &&
+             RHS.getLower().isEQ(RHS.getUpper()) &&
+             LHS.getLower().isEQ(RHS.getLower());
+    case CmpInst::ICMP_NE:
+      return LHS.getUpper().isLT(RHS.getLower()) ||
+             LHS.getLower().isGT(RHS.getUpper());
+    default:
+      return false;
+  }
+}
+
+bool SymbolicRangeCheckElimination::foldCompare(ICmpInst *ICI) {
+  if (!ICI->getOperand(0)->getType()->isIntegerTy())
+    return false;
+
+  Value *LHS = SRA_->getDef(ICI->getOperandUse(0)),
+        *RHS = SRA_->getDef(ICI->getOperandUse(1));
+  if (SRA_->mayWrap(LHS) || SRA_->mayWrap(RHS))
+    return false;
+
+  SymRange LR = SRA_->getStateOrInf(LHS), RR = SRA_->getStateOrInf(RHS);
+  Constant *Result;
+  if (isKnown(ICI->getPredicate(), LR, RR))
+    Result = ConstantInt::getTrue(ICI->getContext());
+  else if (isKnown(ICI->getInversePredicate(), LR, RR))
+    Result = ConstantInt::getFalse(ICI->getContext());
+  else
+    return false;
+
+  DEBUG(dbgs() << "SRA-CHECK-ELIM: " << *ICI << " is " << *Result
+               << ", with " << LR << " and " << RR << "\n");
+  ICI->replaceAllUsesWith(Result);
+  ++NumComparesFolded;
+  return true;
+}
+
+// The overflow bit of an arithmetic-with-overflow intrinsic is false when
+// the range of the exact result fits in the type.
+bool SymbolicRangeCheckElimination::foldOverflowCheck(IntrinsicInst *II) {
+  bool IsSigned;
+  switch (II->getIntrinsicID()) {
+    case Intrinsic::sadd_with_overflow:
+    case Intrinsic::ssub_with_overflow:
+    case Intrinsic::smul_with_overflow:
+      IsSigned = true;
+      break;
+    case Intrinsic::uadd_with_overflow:
+    case Intrinsic::usub_with_overflow:
+    case Intrinsic::umul_with_overflow:
+      IsSigned = false;
+      break;
+    default:
+      return false;
+  }
+
+  IntegerType *Ty = cast<IntegerType>(II->getArgOperand(0)->getType());
+  if (Ty->getBitWidth() > 64)
+    return false;
+
+  Value *LHS = SRA_->getDef(II->getOperandUse(0)),
+        *RHS = SRA_->getDef(II->getOperandUse(1));
+  if (SRA_->mayWrap(LHS) || SRA_->mayWrap(RHS))
+    return false;
+
+  SymRange LR = SRA_->getStateOrInf(LHS), RR = SRA_->getStateOrInf(RHS);
+  SymContext &Ctx = SRA_->getContext();
+  SymExpr Min(Ctx, (int64_t) 0), Max(Ctx, (int64_t) 0);
+  if (IsSigned) {
+    Min = SymExpr(Ctx, APInt::getSignedMinValue(Ty->getBitWidth())
+                           .getSExtValue());
+    Max = SymExpr(Ctx, APInt::getSignedMaxValue(Ty->getBitWidth())
+                           .getSExtValue());
+  } else {
+    // Bounds are signed 64-bit integers, so i64 results are only proven not
+    // to overflow below INT64_MAX.
+    if (!LR.getLower().isGE(Min) || !RR.getLower().isGE(Min))
+      return false;
+    Max = SymExpr(Ctx, (int64_t) std::min<uint64_t>(
+        APInt::getMaxValue(Ty->getBitWidth()).getZExtValue(),
+        std::numeric_limits<int64_t>::max()));
+  }
+
+  SymRange Result = LR;
+  switch (II->getIntrinsicID()) {
+    case Intrinsic::sadd_with_overflow:
+    case Intrinsic::uadd_with_overflow:
+      Result = LR + RR;
+      break;
+    case Intrinsic::ssub_with_overflow:
+    case Intrinsic::usub_with_overflow:
+      Result = LR - RR;
+      break;
+    default:
+      Result = LR * RR;
+      break;
+  }
+
+  if (!Result.getLower().isGE(Min) || !Result.getUpper().isLE(Max))
+    return false;
+
+  bool Changed = false;
+  for (auto U : II->users())
+    if (auto EVI = dyn_cast<ExtractValueInst>(U))
+      if (EVI->getNumIndices() == 1 && *EVI->idx_begin() == 1) {
+        DEBUG(dbgs() << "SRA-CHECK-ELIM: " << *II << " cannot overflow, with "
+                     << Result << "\n");
+        EVI->replaceAllUsesWith(ConstantInt::getFalse(II->getContext()));
+        ++NumOverflowsRemoved;
+        Changed = true;
+      }
+  return Changed;
+}
+
+bool SymbolicRangeCheckElimination::runOnFunction(Function& F) {
+  SRA_ = &getAnalysis<SymbolicRangeAnalysis>();
+  bool Changed = false;
+
+  for (auto &BB : F)
+    for (auto &I : BB)
+      if (ICmpInst *ICI = dyn_cast<ICmpInst>(&I))
+        Changed |= foldCompare(ICI);
+      else if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(&I))
+        Changed |= foldOverflowCheck(II);
+
+  // Branches on folded checks now have constant conditions.
+  for (auto &BB : F) {
+    BranchInst *BI = dyn_cast<BranchInst>(BB.getTerminator());
+    if (BI && BI->isConditional() && isa<ConstantInt>(BI->getCondition()) &&
+        ConstantFoldTerminator(&BB)) {
+      ++NumBranchesFolded;
+      Changed = true;
+    }
+  }
+
+  return Changed;
+}
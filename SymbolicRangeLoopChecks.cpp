@@ -0,0 +1,308 @@
+//===--------------------- SymbolicRangeLoopChecks.cpp --------------------===//
+//===----------------------------------------------------------------------===//
+
+#include "SymbolicRangeAnalysis.h"
+
+#define DEBUG_TYPE "sra-loop-checks"
+
+#include "llvm/Pass.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+using namespace llvm;
+
+STATISTIC(NumLoopsVersioned, "Number of loops versioned");
+STATISTIC(NumChecksHoisted,  "Number of checks hoisted out of loops");
+
+// Hoists the range checks of innermost loops into their preheaders. A check
+// is a conditional branch on an icmp between a loop-variant value and a
+// loop-invariant bound, whose failing successor leaves the loop for a block
+// ending in unreachable (a trap or an abort). The range of the loop-variant
+// value is materialized once in the preheader and tested against the bound:
+// if every check of the loop is known to pass, a clone of the loop without
+// the checks runs instead of the original one.
+class SymbolicRangeLoopChecks : public FunctionPass {
+public:
+  static char ID;
+  SymbolicRangeLoopChecks() : FunctionPass(ID) { }
+
+  virtual void getAnalysisUsage(AnalysisUsage &AU) const;
+  virtual bool runOnFunction(Function&);
+
+private:
+  struct Check {
+    BranchInst        *BI;
+    Value             *V;
+    Value             *Bound;
+    CmpInst::Predicate Pred; // V Pred Bound holds when the check passes.
+    BasicBlock        *Pass;
+  };
+
+  bool findCheck(Loop *L, BranchInst *BI, Check &C);
+  Value *materializeCheck(const Check &C, IRBuilder<> &IRB);
+  bool dominatesPreheader(Value *V, BasicBlock *Preheader,
+                          const SmallPtrSetImpl<Instruction*> &New);
+  bool versionLoop(Loop *L);
+
+  SymbolicRangeAnalysis *SRA_;
+  DominatorTree         *DT_;
+};
+
+static RegisterPass<SymbolicRangeLoopChecks>
+  X("sra-loop-checks", "Symbolic range analysis loop check hoisting");
+char SymbolicRangeLoopChecks::ID = 0;
+
+void SymbolicRangeLoopChecks::getAnalysisUsage(AnalysisUsage &AU) const {
+  // Loops must be in simplified and LCSSA form before e-SSA is built on them.
+  AU.addRequiredID(LoopSimplifyID);
+  AU.addRequiredID(LCSSAID);
+  AU.addRequired<LoopInfoWrapperPass>();
+  AU.addRequired<DominatorTreeWrapperPass>();
+  AU.addRequired<SymbolicRangeAnalysis>();
+}
+
+static bool IsFailureBlock(BasicBlock *BB) {
+  return isa<UnreachableInst>(BB->getTerminator());
+}
+
+bool SymbolicRangeLoopChecks::findCheck(Loop *L, BranchInst *BI, Check &C) {
+  if (!BI->isConditional())
+    return false;
+  ICmpInst *ICI = dyn_cast<ICmpInst>(BI->getCondition());
+  if (!ICI || !ICI->getOperand(0)->getType()->isIntegerTy())
+    return false;
+
+  // The check passes along the successor that stays out of the failure
+  // block, i.e. when the comparison is true for the first successor.
+  BasicBlock *TB = BI->getSuccessor(0), *FB = BI->getSuccessor(1);
+  CmpInst::Predicate Pred = ICI->getPredicate();
+  if (!L->contains(FB) && IsFailureBlock(FB)) {
+    C.Pass = TB;
+  } else if (!L->contains(TB) && IsFailureBlock(TB)) {
+    C.Pass = FB;
+    Pred = ICI->getInversePredicate();
+  } else {
+    return false;
+  }
+
+  Value *LHS = ICI->getOperand(0), *RHS = ICI->getOperand(1);
+  if (L->isLoopInvariant(LHS) && !L->isLoopInvariant(RHS)) {
+    std::swap(LHS, RHS);
+    Pred = ICmpInst::getSwappedPredicate(Pred);
+  }
+  if (L->isLoopInvariant(LHS) || !L->isLoopInvariant(RHS))
+    return false;
+
+  C.BI    = BI;
+  C.V     = LHS;
+  C.Bound = RHS;
+  C.Pred  = Pred;
+  return true;
+}
+
+// Returns the condition under which the check passes for every value in the
+// range of C.V, or null if the range may not hold, or cannot be emitted on
+// the side that matters. Bounds are sums and products of values of the type
+// of C.V, which may overflow it even when the bounds themselves fit, so they
+// are emitted, and compared, in a type twice as wide.
+Value *SymbolicRangeLoopChecks::materializeCheck(const Check &C,
+                                                 IRBuilder<> &IRB) {
+  if (SRA_->mayWrap(C.V))
+    return nullptr;
+
+  IntegerType *Ty = cast<IntegerType>(C.V->getType()),
+              *WideTy = IntegerType::get(Ty->getContext(),
+                                         2 * Ty->getBitWidth());
+  SymRange Range = SRA_->getStateOrInf(C.V);
+  bool NeedsLower = false, NeedsUpper = false;
+  switch (C.Pred) {
+    case CmpInst::ICMP_SLT:
+    case CmpInst::ICMP_SLE:
+      NeedsUpper = true;
+      break;
+    case CmpInst::ICMP_SGT:
+    case CmpInst::ICMP_SGE:
+      NeedsLower = true;
+      break;
+    case CmpInst::ICMP_ULT:
+    case CmpInst::ICMP_ULE:
+      // Non-negative values compare the same way signed and unsigned.
+      NeedsLower = NeedsUpper = true;
+      break;
+    default:
+      return nullptr;
+  }
+  if ((NeedsLower &&
+       !SRA_->isMaterializable(Range.getLower(), Ty, WideTy)) ||
+      (NeedsUpper &&
+       !SRA_->isMaterializable(Range.getUpper(), Ty, WideTy)))
+    return nullptr;
+
+  auto Bounds = SRA_->getRangeValuesFor(C.V, IRB, nullptr, WideTy);
+  switch (C.Pred) {
+    case CmpInst::ICMP_SLT:
+    case CmpInst::ICMP_SLE:
+      return IRB.CreateICmp(C.Pred, Bounds.second,
+                            IRB.CreateSExt(C.Bound, WideTy));
+    case CmpInst::ICMP_SGT:
+    case CmpInst::ICMP_SGE:
+      return IRB.CreateICmp(C.Pred, Bounds.first,
+                            IRB.CreateSExt(C.Bound, WideTy));
+    default:
+      return IRB.CreateAnd(
+          IRB.CreateICmpSGE(Bounds.first, ConstantInt::get(WideTy, 0)),
+          IRB.CreateICmp(C.Pred, Bounds.second,
+                         IRB.CreateZExt(C.Bound, WideTy)));
+  }
+}
+
+// Bounds are built from the values named by their symbols, some of which may
+// be defined inside the loop.
+bool SymbolicRangeLoopChecks::dominatesPreheader(
+    Value *V, BasicBlock *Preheader,
+    const SmallPtrSetImpl<Instruction*> &New) {
+  Instruction *I = dyn_cast<Instruction>(V);
+  return !I || New.count(I) || DT_->dominates(I, Preheader->getTerminator());
+}
+
+bool SymbolicRangeLoopChecks::versionLoop(Loop *L) {
+  BasicBlock *Preheader = L->getLoopPreheader();
+  if (!Preheader || !L->isLCSSAForm(*DT_))
+    return false;
+
+  std::vector<Check> Checks;
+  for (auto BB : L->blocks())
+    if (BranchInst *BI = dyn_cast<BranchInst>(BB->getTerminator())) {
+      Check C;
+      if (findCheck(L, BI, C))
+        Checks.push_back(C);
+    }
+  if (Checks.empty())
+    return false;
+
+  // Materialize the hoisted conditions before the preheader's terminator.
+  TerminatorInst *PreTerm = Preheader->getTerminator();
+  Instruction *Prev = PreTerm->getPrevNode();
+  IRBuilder<> IRB(PreTerm);
+  Value *Cond = nullptr;
+  for (auto &C : Checks) {
+    Value *Passes = materializeCheck(C, IRB);
+    if (!Passes) {
+      Cond = nullptr;
+      break;
+    }
+    Cond = Cond ? IRB.CreateAnd(Cond, Passes) : Passes;
+  }
+
+  SmallVector<Instruction*, 16> Inserted;
+  auto NI = Prev ? ++BasicBlock::iterator(Prev) : Preheader->begin();
+  for (; &*NI != PreTerm; ++NI)
+    Inserted.push_back(&*NI);
+  SmallPtrSet<Instruction*, 16> New(Inserted.begin(), Inserted.end());
+
+  bool Valid = Cond != nullptr;
+  for (auto I : Inserted)
+    for (auto &Op : I->operands())
+      Valid = Valid && dominatesPreheader(Op, Preheader, New);
+  if (!Valid) {
+    DEBUG(dbgs() << "SRA-LOOP-CHECKS: cannot hoist the checks of "
+                 << L->getHeader()->getName() << "\n");
+    while (!Inserted.empty())
+      Inserted.pop_back_val()->eraseFromParent();
+    return false;
+  }
+
+  // Clone the loop and remove the checks from the clone.
+  Function *F = Preheader->getParent();
+  ValueToValueMapTy VMap;
+  std::vector<BasicBlock*> Clones;
+  for (auto BB : L->blocks()) {
+    BasicBlock *Clone = CloneBasicBlock(BB, VMap, ".unchecked", F);
+    VMap[BB] = Clone;
+    Clones.push_back(Clone);
+  }
+  for (auto Clone : Clones)
+    for (auto &I : *Clone)
+      RemapInstruction(&I, VMap,
+                       RF_NoModuleLevelChanges | RF_IgnoreMissingEntries);
+
+  for (auto &C : Checks) {
+    BranchInst *BI = cast<BranchInst>(VMap[C.BI]);
+    BasicBlock *Pass = L->contains(C.Pass) ? cast<BasicBlock>(VMap[C.Pass])
+                                           : C.Pass;
+    BranchInst::Create(Pass, BI);
+    BI->eraseFromParent();
+  }
+
+  // In LCSSA form, values leave the loop only through the phis of its exit
+  // blocks, which now also take their values from the clone.
+  SmallVector<BasicBlock*, 4> Exits;
+  L->getUniqueExitBlocks(Exits);
+  for (auto Exit : Exits)
+    for (auto &I : *Exit) {
+      PHINode *Phi = dyn_cast<PHINode>(&I);
+      if (!Phi)
+        break;
+      for (unsigned Idx = 0, E = Phi->getNumIncomingValues(); Idx != E; ++Idx) {
+        BasicBlock *Incoming = Phi->getIncomingBlock(Idx);
+        if (!L->contains(Incoming))
+          continue;
+        BasicBlock *Clone = cast<BasicBlock>(VMap[Incoming]);
+        TerminatorInst *TI = Clone->getTerminator();
+        bool Reaches = false;
+        for (unsigned S = 0; S < TI->getNumSuccessors(); ++S)
+          Reaches = Reaches || TI->getSuccessor(S) == Exit;
+        if (!Reaches)
+          continue;
+        Value *V = Phi->getIncomingValue(Idx);
+        Value *Mapped = VMap.count(V) ? (Value*) VMap[V] : V;
+        Phi->addIncoming(Mapped, Clone);
+      }
+    }
+
+  BasicBlock *Header = L->getHeader();
+  BranchInst::Create(cast<BasicBlock>(VMap[Header]), Header, Cond, PreTerm);
+  PreTerm->eraseFromParent();
+
+  DEBUG(dbgs() << "SRA-LOOP-CHECKS: hoisted " << Checks.size()
+               << " checks out of " << Header->getName() << "\n");
+  ++NumLoopsVersioned;
+  NumChecksHoisted += Checks.size();
+  return true;
+}
+
+bool SymbolicRangeLoopChecks::runOnFunction(Function& F) {
+  SRA_ = &getAnalysis<SymbolicRangeAnalysis>();
+  DT_  = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+  LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+
+  // Innermost loops are disjoint, so versioning one leaves the blocks of the
+  // others intact. Dominance does change, though: the blocks of a versioned
+  // loop no longer dominate its exits, which the clone also reaches, so the
+  // tree is recomputed before the bounds of the next loop are checked.
+  std::vector<Loop*> Worklist(LI.begin(), LI.end()), Innermost;
+  while (!Worklist.empty()) {
+    Loop *L = Worklist.back();
+    Worklist.pop_back();
+    if (L->empty())
+      Innermost.push_back(L);
+    Worklist.insert(Worklist.end(), L->begin(), L->end());
+  }
+
+  bool Changed = false;
+  for (auto L : Innermost)
+    if (versionLoop(L)) {
+      DT_->recalculate(F);
+      Changed = true;
+    }
+  return Changed;
+}
@@ -0,0 +1,197 @@
+//===--------------------- SymbolicRangeMetadata.cpp ----------------------===//
+//===----------------------------------------------------------------------===//
+
+#include "SymbolicRangeMetadata.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Type.h"
+
+using namespace llvm;
+
+#ifdef SRA_NATIVE_EXPR
+
+static const char *GetTag(NativeNode::NodeKind Kind) {
+  switch (Kind) {
+    case NativeNode::NK_Add: return "add";
+    case NativeNode::NK_Mul: return "mul";
+    case NativeNode::NK_Div: return "div";
+    case NativeNode::NK_Min: return "min";
+    case NativeNode::NK_Max: return "max";
+    default:                 return nullptr;
+  }
+}
+
+static Metadata *GetInt(LLVMContext &C, int64_t Int) {
+  return ConstantAsMetadata::get(
+      ConstantInt::get(Type::getInt64Ty(C), Int, /*isSigned=*/true));
+}
+
+Metadata *SymbolicRangeMetadata::encodeNode(const NativeNode *N) {
+  Metadata *&Slot = Nodes_[N];
+  if (Slot)
+    return Slot;
+
+  Metadata *MD = nullptr;
+  switch (N->getKind()) {
+    case NativeNode::NK_Int:
+      MD = GetInt(C_, N->getInt());
+      break;
+    case NativeNode::NK_Sym:
+      MD = MDString::get(C_, N->getName());
+      break;
+    case NativeNode::NK_MinusInf:
+      MD = MDString::get(C_, "-Infinity");
+      break;
+    case NativeNode::NK_PlusInf:
+      MD = MDString::get(C_, "+Infinity");
+      break;
+    case NativeNode::NK_Undef:
+      MD = MDString::get(C_, "NaN");
+      break;
+    default: {
+      SmallVector<Metadata*, 8> Ops;
+      Ops.push_back(MDString::get(C_, GetTag(N->getKind())));
+      if (N->getKind() == NativeNode::NK_Add)
+        Ops.push_back(GetInt(C_, N->getInt()));
+      for (unsigned Idx = 0; Idx < N->getOps().size(); ++Idx) {
+        Ops.push_back(encodeNode(N->getOps()[Idx]));
+        if (N->getKind() == NativeNode::NK_Add)
+          Ops.push_back(GetInt(C_, N->getCoeffs()[Idx]));
+      }
+      MD = MDTuple::get(C_, Ops);
+      break;
+    }
+  }
+
+  // Nodes_ may have grown while encoding the operands.
+  Nodes_[N] = MD;
+  return MD;
+}
+
+MDNode *SymbolicRangeMetadata::encode(const SymRange &Range) {
+  Metadata *Bounds[] = {
+    encodeNode(Range.getNode()->Lower), encodeNode(Range.getNode()->Upper)
+  };
+  return MDTuple::get(C_, Bounds);
+}
+
+static bool ReadInt(const Metadata *MD, int64_t &Int) {
+  auto CMD = dyn_cast_or_null<ConstantAsMetadata>(MD);
+  if (!CMD || !isa<ConstantInt>(CMD->getValue()))
+    return false;
+  Int = cast<ConstantInt>(CMD->getValue())->getSExtValue();
+  return true;
+}
+
+static const NativeNode *DecodeNode(const Metadata *MD, NativeContext &Ctx) {
+  int64_t Int;
+  if (ReadInt(MD, Int))
+    return Ctx.getInt(Int);
+
+  if (auto Str = dyn_cast_or_null<MDString>(MD)) {
+    StringRef Name = Str->getString();
+    if (Name == "-Infinity")
+      return Ctx.getMinusInf();
+    if (Name == "+Infinity")
+      return Ctx.getPlusInf();
+    if (Name == "NaN")
+      return Ctx.getUndef();
+    return Ctx.getSym(Name);
+  }
+
+  auto Tuple = dyn_cast_or_null<MDTuple>(MD);
+  if (!Tuple || Tuple->getNumOperands() < 2)
+    return nullptr;
+  auto Tag = dyn_cast_or_null<MDString>(Tuple->getOperand(0).get());
+  if (!Tag)
+    return nullptr;
+
+  // Operations are replayed through the context, so that the result is
+  // canonical in it.
+  if (Tag->getString() == "add") {
+    if (Tuple->getNumOperands() % 2 || !ReadInt(Tuple->getOperand(1), Int))
+      return nullptr;
+    const NativeNode *Ret = Ctx.getInt(Int);
+    for (unsigned Idx = 2; Idx < Tuple->getNumOperands(); Idx += 2) {
+      const NativeNode *Op = DecodeNode(Tuple->getOperand(Idx), Ctx);
+      if (!Op || !ReadInt(Tuple->getOperand(Idx + 1), Int))
+        return nullptr;
+      Ret = Ctx.getAdd(Ret, Ctx.getMul(Op, Ctx.getInt(Int)));
+    }
+    return Ret;
+  }
+
+  const NativeNode *Ret = nullptr;
+  for (unsigned Idx = 1; Idx < Tuple->getNumOperands(); ++Idx) {
+    const NativeNode *Op = DecodeNode(Tuple->getOperand(Idx), Ctx);
+    if (!Op)
+      return nullptr;
+    if (!Ret)
+      Ret = Op;
+    else if (Tag->getString() == "mul")
+      Ret = Ctx.getMul(Ret, Op);
+    else if (Tag->getString() == "div")
+      Ret = Ctx.getDiv(Ret, Op);
+    else if (Tag->getString() == "min")
+      Ret = Ctx.getMin(Ret, Op);
+    else if (Tag->getString() == "max")
+      Ret = Ctx.getMax(Ret, Op);
+    else
+      return nullptr;
+  }
+  return Ret;
+}
+
+bool SymbolicRangeMetadata::decode(const MDNode *MD, NativeContext &Ctx,
+                                   NativeRange &Range) {
+  if (!MD || MD->getNumOperands() != 2)
+    return false;
+
+  const NativeNode *Lower = DecodeNode(MD->getOperand(0), Ctx),
+                   *Upper = DecodeNode(MD->getOperand(1), Ctx);
+  if (!Lower || !Upper)
+    return false;
+
+  Range = NativeRange(NativeExpr(Ctx, Lower), NativeExpr(Ctx, Upper));
+  return true;
+}
+
+bool SymbolicRangeMetadata::matches(const MDNode *MD, const SymRange &Range) {
+  NativeRange Decoded = Range;
+  return decode(MD, Range.getLower().getContext(), Decoded) &&
+         Decoded == Range;
+}
+
+void SymbolicRangeMetadata::print(raw_ostream &OS, const MDNode *MD) {
+  NativeContext Ctx;
+  NativeRange Range(NativeExpr(Ctx, Ctx.getUndef()));
+  if (decode(MD, Ctx, Range))
+    OS << Range;
+  else
+    OS << "<invalid range metadata>";
+}
+
+#else
+
+MDNode *SymbolicRangeMetadata::encode(const SymRange &Range) {
+  std::string Str;
+  raw_string_ostream Stream(Str);
+  Stream << Range;
+  return MDNode::get(C_, MDString::get(C_, Stream.str()));
+}
+
+bool SymbolicRangeMetadata::matches(const MDNode *MD, const SymRange &Range) {
+  return encode(Range) == MD;
+}
+
+void SymbolicRangeMetadata::print(raw_ostream &OS, const MDNode *MD) {
+  if (MD && MD->getNumOperands() == 1)
+    if (auto Str = dyn_cast_or_null<MDString>(MD->getOperand(0).get())) {
+      OS << Str->getString();
+      return;
+    }
+  OS << "<invalid range metadata>";
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef _SYMBOLICRANGEMETADATA_H_
+#define _SYMBOLICRANGEMETADATA_H_
+
+#include "SymbolicExpr.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+// Encoding of symbolic ranges as instruction metadata.
+//
+// With the native backend, a range is the tuple !{Lower, Upper}. A bound is
+// an i64 constant, a string (a symbol name, or one of "-Infinity",
+// "+Infinity" and "NaN"), or a tuple tagged with its operation:
+//
+//   !{!"add", i64 C, Op1, i64 C1, Op2, i64 C2, ...}  (C + C1*Op1 + C2*Op2...)
+//   !{!"mul", Op1, Op2, ...}
+//   !{!"div", Op1, Op2}
+//   !{!"min", Op1, Op2, ...}
+//   !{!"max", Op1, Op2, ...}
+//
+// Metadata tuples are uniqued, so identical ranges and subexpressions share
+// nodes, and two encodings are equal exactly when they are the same node.
+// With SAGE, a range is kept as !{!"<printed range>"}.
+class SymbolicRangeMetadata {
+public:
+  explicit SymbolicRangeMetadata(LLVMContext &C) : C_(C) { }
+
+  // The metadata kind ranges are attached under.
+  static StringRef getKindName() { return "sra"; }
+
+  // Encodings are memoized per expression node, so an encoder must not
+  // outlive the context of the ranges it encodes.
+  MDNode *encode(const SymRange &Range);
+
+#ifdef SRA_NATIVE_EXPR
+  // Rebuilds the range encoded by MD in Ctx. Returns false if MD is not a
+  // valid encoding.
+  static bool decode(const MDNode *MD, NativeContext &Ctx, NativeRange &Range);
+#endif
+
+  // Returns true if MD encodes Range. With the native backend, MD is decoded
+  // in the context of Range, where equal ranges are identical.
+  bool matches(const MDNode *MD, const SymRange &Range);
+
+  // Prints the range encoded by MD as the analysis would.
+  static void print(raw_ostream &OS, const MDNode *MD);
+
+private:
+#ifdef SRA_NATIVE_EXPR
+  Metadata *encodeNode(const NativeNode *N);
+
+  DenseMap<const NativeNode*, Metadata*> Nodes_;
+#endif
+
+  LLVMContext &C_;
+};
+
+#endif